@@ -3,31 +3,58 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <assert.h>
 #include "BLQueue.h"
 #include "HazardPointer.h"
+#include "QueueBackoff.h"
+#include "QueueDelay.h"
+#include "QueueOrder.h"
+#include "QueueProfile.h"
+#include "QueueTrace.h"
 
 struct BLNode;
 typedef struct BLNode BLNode;
 typedef _Atomic(BLNode*) AtomicBLNodePtr;
 
+//Producers bump push_idx and consumers pop_idx on every operation, so each has its own cache line;
+//next and birth are written once. The buffer follows pop_idx unpadded, as padding it costs every node.
+//Memory orders: nodes are published like LLQueue's (release CAS on tail, release store of next, acquire
+//loads of next, release CAS on head, acquire in protect). The indices only hand out slots, which their
+//atomicity does, so they are relaxed. An item is published by its release exchange into the slot and
+//taken by an acquire exchange, which orders what its producer wrote before pushing it before the pop.
 struct BLNode {
     AtomicBLNodePtr next;
+    uint64_t birth; //HazardPointer_era when allocated.
+    _Alignas(64) _Atomic int push_idx;
+    _Alignas(64) _Atomic int pop_idx;
     _Atomic Value buffer [BUFFER_SIZE];
-    _Atomic int push_idx; 
-    _Atomic int pop_idx; 
 };
 
+//Read-only fields, head (consumers) and tail (producers) on separate cache lines, as is the backoff
+//rate, which contended operations write.
 struct BLQueue {
-    AtomicBLNodePtr head;
-    AtomicBLNodePtr tail;
-    HazardPointer hp;
+    HazardPointer* hp;
+    bool owns_hp; //False if the HazardPointer is shared with other queues.
+    QueueBackoffPolicy backoff;
+    _Alignas(64) AtomicBLNodePtr head;
+    _Alignas(64) AtomicBLNodePtr tail;
+    _Alignas(64) _Atomic uint32_t backoff_rate; //Failures per operation, for QUEUE_BACKOFF_ADAPTIVE.
+    QUEUE_STATS_DECLARE
 };
 
+//Waits before retrying a failed attempt, as the queue's QueueBackoffPolicy says.
+static inline void BLQueue_back_off(BLQueue* queue, QueueBackoff* backoff) {
+    uint32_t spins = QueueBackoff_fail(backoff);
+    QUEUE_STAT_ADD(queue, backoff_spins, spins);
+    (void)spins;
+}
+
 //Creates new node with all values in buffer = EMPTY_VALUE.
-BLNode* BLNode_new() {
-    BLNode* node = (BLNode*)malloc(sizeof(BLNode));
+BLNode* BLNode_new(uint64_t birth) {
+    BLNode* node = (BLNode*)aligned_alloc(_Alignof(BLNode), sizeof(BLNode));
     assert(node);
+    node->birth = birth;
 
     atomic_init(&(node->push_idx), 0);
     atomic_init(&(node->pop_idx), 0);
@@ -40,9 +67,10 @@ BLNode* BLNode_new() {
 }
 
 //Creates new node with first value in buffer = value, rest is EMPTY_VALUE.
-BLNode* BLNode_new_with_value(Value value) {
-    BLNode* node = (BLNode*)malloc(sizeof(BLNode));
+BLNode* BLNode_new_with_value(Value value, uint64_t birth) {
+    BLNode* node = (BLNode*)aligned_alloc(_Alignof(BLNode), sizeof(BLNode));
     assert(node);
+    node->birth = birth;
 
     atomic_init(&(node->push_idx), 1);
     atomic_init(&(node->pop_idx), 0);
@@ -57,144 +85,276 @@ BLNode* BLNode_new_with_value(Value value) {
 
 //Creates new BLQueue. Initializes its HazardPointer. 
 BLQueue* BLQueue_new(void) {
-    BLQueue* queue = (BLQueue*)malloc(sizeof(BLQueue));
+    return BLQueue_new_with_scheme(RECLAMATION_SCHEME);
+}
+
+static BLQueue* BLQueue_new_on(HazardPointer* hp, bool owns_hp) {
+    BLQueue* queue = (BLQueue*)aligned_alloc(_Alignof(BLQueue), sizeof(BLQueue));
     assert(queue);
 
-    HazardPointer_initialize(&queue->hp);
+    queue->hp = hp;
+    queue->owns_hp = owns_hp;
+    queue->backoff = BACKOFF_POLICY;
+    atomic_init(&queue->backoff_rate, 0);
+    QUEUE_STATS_INIT(queue);
 
-    BLNode* node = BLNode_new();
+    BLNode* node = BLNode_new(HazardPointer_era(queue->hp));
     atomic_init(&(queue->head),node);
     atomic_init(&(queue->tail),node);
 
     return queue;
 }
 
+BLQueue* BLQueue_new_with_scheme(int scheme) {
+    HazardPointer* hp = HazardPointer_new(scheme);
+    HazardPointer_set_node_size(hp, sizeof(BLNode));
+    return BLQueue_new_on(hp, true);
+}
+
+BLQueue* BLQueue_new_shared(HazardPointer* hp) {
+    if (hp->node_size == 0) HazardPointer_set_node_size(hp, sizeof(BLNode));
+    return BLQueue_new_on(hp, false);
+}
+
 void BLQueue_delete(BLQueue* queue) {
-    BLNode* curr = atomic_load(&(queue->head)), *next = NULL;
+    BLNode* curr = atomic_load_explicit(&(queue->head), QUEUE_RELAXED), *next = NULL; //Single-threaded.
     //if (curr == NULL) printf("BLQueue_delete: Head should never be NULL!");
 
     while (curr != NULL) {
-        next = atomic_load(&curr->next);
+        next = atomic_load_explicit(&curr->next, QUEUE_RELAXED);
         free(curr);
         curr = next;
     }
 
-    HazardPointer_finalize(&queue->hp);
+    if (queue->owns_hp) HazardPointer_delete(queue->hp);
     free(queue);
     queue = NULL;
 }
 
 
 void BLQueue_push(BLQueue* queue, Value item) {
+    HazardPointer_Handle handle;
+    HazardPointer_handle(queue->hp, &handle);
+    BLQueue_push_with(queue, &handle, item);
+}
+
+void BLQueue_push_with(BLQueue* queue, HazardPointer_Handle* handle, Value item) {
+    QUEUE_TRACE_BEGIN("BLQueue_push");
+    QUEUE_PROFILE_BEGIN();
+    QUEUE_STAT_ADD(queue, operations, 1);
+    QueueBackoff backoff;
+    QueueBackoff_begin(&backoff, queue->backoff, &queue->backoff_rate);
     bool finished = false;
     while (!finished) { 
+        QUEUE_STAT_ADD(queue, iterations, 1);
 
-        BLNode* expected_tail = HazardPointer_protect(&(queue->hp), (const _Atomic(void*)*)&(queue->tail));
+        BLNode* expected_tail = HazardPointer_protect_with(handle, 0, (const _Atomic(void*)*)&(queue->tail));
         //if (expected_tail == NULL) printf("BLQueue_push: tail should never be NULL!");
 
-        //Start again tail has changed. 
-        if (expected_tail != atomic_load(&(queue->tail))) continue; 
+        //Start again tail has changed. Only a shortcut, protect already validated the pointer.
+        bool moved = expected_tail != atomic_load_explicit(&(queue->tail), QUEUE_RELAXED);
+        QUEUE_PROFILE_LAP(QUEUE_PROFILE_BL_PUSH, QUEUE_PROFILE_PROTECT);
+        if (moved) {
+            BLQueue_back_off(queue, &backoff);
+            QUEUE_PROFILE_LAP(QUEUE_PROFILE_BL_PUSH, QUEUE_PROFILE_BACKOFF);
+            continue;
+        }
 
-        int idx = atomic_fetch_add(&(expected_tail->push_idx), 1);
+        int idx = atomic_fetch_add_explicit(&(expected_tail->push_idx), 1, QUEUE_RELAXED);
+        QUEUE_PROFILE_LAP(QUEUE_PROFILE_BL_PUSH, QUEUE_PROFILE_INDEX);
         
         //Buffer not full - we still can insert into it.
         if (idx < BUFFER_SIZE) {
-            Value value_read = atomic_exchange(&expected_tail->buffer[idx], item); 
+            QUEUE_DELAY_POINT(QUEUE_DELAY_BL_PUSH_SLOT);
+            //Release publishes the item; TAKEN_VALUE carries nothing to acquire.
+            Value value_read = atomic_exchange_explicit(&expected_tail->buffer[idx], item, QUEUE_RELEASE);
+            QUEUE_PROFILE_LAP(QUEUE_PROFILE_BL_PUSH, QUEUE_PROFILE_EXCHANGE);
             if (value_read != TAKEN_VALUE) {
                 //== EMPTY_VALUE, we inserted item.
                 finished = true;
             }
             //Else: start again - value was already taken by pop-thread. 
+            else {
+                QUEUE_TRACE_EVENT("slot_taken", expected_tail);
+            }
         }
 
         //Buffer full. 
         else {  
-            BLNode* next = atomic_load(&expected_tail->next);
+            //Acquire, as the next node is passed on through tail.
+            BLNode* next = atomic_load_explicit(&expected_tail->next, QUEUE_ACQUIRE);
+            bool lost = false; //A CAS on tail failed.
 
             //Try to insert new tail (new node).
             if (next == NULL) { 
-                BLNode* new_node = BLNode_new_with_value(item);
-                if (!atomic_compare_exchange_strong(&(queue->tail), &expected_tail, new_node)) {
+                BLNode* new_node = BLNode_new_with_value(item, HazardPointer_era(queue->hp));
+                QUEUE_PROFILE_LAP(QUEUE_PROFILE_BL_PUSH, QUEUE_PROFILE_ALLOC);
+                QUEUE_STAT_ADD(queue, node_allocs, 1);
+                QUEUE_TRACE_EVENT("node_alloc", new_node);
+                //Release publishes new_node with the item in its first slot.
+                if (!atomic_compare_exchange_strong_explicit(&(queue->tail), &expected_tail, new_node, QUEUE_RELEASE, QUEUE_RELAXED)) {
                     //Exchange unsuccessful, free new_node and start again. 
                     free(new_node);
+                    QUEUE_STAT_ADD(queue, cas_failures, 1);
+                    QUEUE_STAT_ADD(queue, node_frees, 1);
+                    QUEUE_STAT_ADD(queue, nodes_discarded, 1);
+                    QUEUE_TRACE_EVENT("cas_fail", expected_tail);
+                    lost = true;
                 }
                 else {
                     //Exchange successful, new tail set. Link old tail to new tail. 
-                    if (atomic_load(&(expected_tail->next)) != NULL) printf("Push: expected_tail next should be NULL!\n");
-                    atomic_store(&(expected_tail->next), new_node);
+                    if (atomic_load_explicit(&(expected_tail->next), QUEUE_RELAXED) != NULL) printf("Push: expected_tail next should be NULL!\n");
+                    QUEUE_DELAY_POINT(QUEUE_DELAY_BL_PUSH_LINK);
+                    atomic_store_explicit(&(expected_tail->next), new_node, QUEUE_RELEASE);
+                    QUEUE_STAT_ADD(queue, tail_advances, 1);
+                    QUEUE_TRACE_EVENT("tail_advance", new_node);
                     finished = true;
                 }
             }
 
             //New tail already pushed. Try to change tail and start again.
-            else  atomic_compare_exchange_strong(&(queue->tail), &expected_tail, next);
+            else if (atomic_compare_exchange_strong_explicit(&(queue->tail), &expected_tail, next, QUEUE_RELEASE, QUEUE_RELAXED)) {
+                QUEUE_STAT_ADD(queue, tail_advances, 1);
+                QUEUE_TRACE_EVENT("tail_advance", next);
+            }
+            else {
+                QUEUE_STAT_ADD(queue, cas_failures, 1);
+                QUEUE_TRACE_EVENT("cas_fail", expected_tail);
+                lost = true;
+            }
+            QUEUE_PROFILE_LAP(QUEUE_PROFILE_BL_PUSH, QUEUE_PROFILE_CAS);
+            if (lost) {
+                BLQueue_back_off(queue, &backoff);
+                QUEUE_PROFILE_LAP(QUEUE_PROFILE_BL_PUSH, QUEUE_PROFILE_BACKOFF);
+            }
         }
     }
-    HazardPointer_clear(&(queue->hp));
+    QueueBackoff_end(&backoff);
+    HazardPointer_clear_with(handle, 0);
+    QUEUE_PROFILE_LAP(QUEUE_PROFILE_BL_PUSH, QUEUE_PROFILE_CLEAR);
+    QUEUE_PROFILE_END(QUEUE_PROFILE_BL_PUSH);
+    QUEUE_TRACE_END("BLQueue_push");
 }
 
 Value BLQueue_pop(BLQueue* queue) {
+    HazardPointer_Handle handle;
+    HazardPointer_handle(queue->hp, &handle);
+    return BLQueue_pop_with(queue, &handle);
+}
+
+Value BLQueue_pop_with(BLQueue* queue, HazardPointer_Handle* handle) {
     Value value = EMPTY_VALUE; //Here we will store head's item.
+    QUEUE_TRACE_BEGIN("BLQueue_pop");
+    QUEUE_PROFILE_BEGIN();
+    QUEUE_STAT_ADD(queue, operations, 1);
+    QueueBackoff backoff;
+    QueueBackoff_begin(&backoff, queue->backoff, &queue->backoff_rate);
     bool finished = false;
 
     while (!finished) {
+        QUEUE_STAT_ADD(queue, iterations, 1);
         value = EMPTY_VALUE;  
-        BLNode* expected_head = HazardPointer_protect(&queue->hp, (const _Atomic(void*)*)&(queue->head));
+        BLNode* expected_head = HazardPointer_protect_with(handle, 0, (const _Atomic(void*)*)&(queue->head));
         //if (expected_head == NULL) printf("BLQueue_pop: head should never be NULL!");
 
-        if (expected_head != atomic_load(&(queue->head))) continue;
+        bool moved = expected_head != atomic_load_explicit(&(queue->head), QUEUE_RELAXED);
+        QUEUE_PROFILE_LAP(QUEUE_PROFILE_BL_POP, QUEUE_PROFILE_PROTECT);
+        if (moved) {
+            BLQueue_back_off(queue, &backoff);
+            QUEUE_PROFILE_LAP(QUEUE_PROFILE_BL_POP, QUEUE_PROFILE_BACKOFF);
+            continue;
+        }
 
-        int idx = atomic_fetch_add(&(expected_head->pop_idx), 1);
+        int idx = atomic_fetch_add_explicit(&(expected_head->pop_idx), 1, QUEUE_RELAXED);
+        QUEUE_PROFILE_LAP(QUEUE_PROFILE_BL_POP, QUEUE_PROFILE_INDEX);
 
         //Bufer not empty.
         if (idx < BUFFER_SIZE && idx >= 0) {
-            value = atomic_exchange(&(expected_head->buffer[idx]), TAKEN_VALUE);  //seg?
+            QUEUE_DELAY_POINT(QUEUE_DELAY_BL_POP_SLOT);
+            //Acquire pairs with the producer's release exchange.
+            value = atomic_exchange_explicit(&(expected_head->buffer[idx]), TAKEN_VALUE, QUEUE_ACQUIRE);
+            QUEUE_PROFILE_LAP(QUEUE_PROFILE_BL_POP, QUEUE_PROFILE_EXCHANGE);
 
             //We took pushed value. Finishing. 
             if (value != EMPTY_VALUE) {
                 finished = true;
             }
-            //Else: start again. 
+            //Else: start again. The slot is now TAKEN_VALUE and will never hold an item.
+            else {
+                QUEUE_STAT_ADD(queue, wasted_slots, 1);
+                QUEUE_STAT_ADD(queue, empty_slot_retries, 1);
+                QUEUE_TRACE_EVENT("slot_wasted", expected_head);
+            }
         }
 
         //Buffer empty. 
         else {
-            BLNode* next = atomic_load(&(expected_head->next)); 
+            //Acquire, as the next node is passed on through head.
+            BLNode* next = atomic_load_explicit(&(expected_head->next), QUEUE_ACQUIRE);
             if (next == NULL) {
                 //Queue empty. Finishing. 
                 finished = true;
             }
             else {
                 //Try to change the head.
-                if (atomic_compare_exchange_strong(&(queue->head), &expected_head, next)) {
+                if (atomic_compare_exchange_strong_explicit(&(queue->head), &expected_head, next, QUEUE_RELEASE, QUEUE_RELAXED)) {
                     //If success - retire the old head. 
-                    HazardPointer_retire(&queue->hp, expected_head);
+                    QUEUE_STAT_ADD(queue, head_advances, 1);
+                    QUEUE_TRACE_EVENT("head_advance", expected_head);
+                    QUEUE_PROFILE_LAP(QUEUE_PROFILE_BL_POP, QUEUE_PROFILE_CAS);
+                    HazardPointer_retire_with(handle, expected_head, expected_head->birth);
+                    QUEUE_PROFILE_LAP(QUEUE_PROFILE_BL_POP, QUEUE_PROFILE_RETIRE);
+                }
+                else {
+                    QUEUE_STAT_ADD(queue, cas_failures, 1);
+                    QUEUE_TRACE_EVENT("cas_fail", expected_head);
+                    QUEUE_PROFILE_LAP(QUEUE_PROFILE_BL_POP, QUEUE_PROFILE_CAS);
+                    BLQueue_back_off(queue, &backoff);
+                    QUEUE_PROFILE_LAP(QUEUE_PROFILE_BL_POP, QUEUE_PROFILE_BACKOFF);
                 }
                 //Start again. 
             }
         }
     }
 
-    HazardPointer_clear(&(queue->hp));
+    QueueBackoff_end(&backoff);
+    HazardPointer_clear_with(handle, 0);
+    QUEUE_PROFILE_LAP(QUEUE_PROFILE_BL_POP, QUEUE_PROFILE_CLEAR);
+    QUEUE_PROFILE_END(QUEUE_PROFILE_BL_POP);
+    QUEUE_TRACE_END("BLQueue_pop");
     return value;
 }
 
 bool BLQueue_is_empty(BLQueue* queue) {
+    HazardPointer_Handle handle;
+    HazardPointer_handle(queue->hp, &handle);
+    return BLQueue_is_empty_with(queue, &handle);
+}
+
+bool BLQueue_is_empty_with(BLQueue* queue, HazardPointer_Handle* handle) {
     Value value = EMPTY_VALUE; //Here we will store head's item.
+    QUEUE_TRACE_BEGIN("BLQueue_is_empty");
+    QUEUE_STAT_ADD(queue, operations, 1);
+    QueueBackoff backoff;
+    QueueBackoff_begin(&backoff, queue->backoff, &queue->backoff_rate);
     bool finished = false;
 
     while (!finished) {
+        QUEUE_STAT_ADD(queue, iterations, 1);
         value = EMPTY_VALUE;  
-        BLNode* expected_head = HazardPointer_protect(&queue->hp, (const _Atomic(void*)*)&(queue->head));
+        BLNode* expected_head = HazardPointer_protect_with(handle, 0, (const _Atomic(void*)*)&(queue->head));
         //if (expected_head == NULL) printf("BLQueue_empty: head should never be NULL!");
 
-        if (expected_head != atomic_load(&(queue->head))) continue;
+        if (expected_head != atomic_load_explicit(&(queue->head), QUEUE_RELAXED)) {
+            BLQueue_back_off(queue, &backoff);
+            continue;
+        }
 
-        int idx = atomic_load(&(expected_head->pop_idx));
+        int idx = atomic_load_explicit(&(expected_head->pop_idx), QUEUE_RELAXED);
 
-        //Bufer not empty.
+        //Bufer not empty. Only the answer is used, so relaxed.
         if (idx < BUFFER_SIZE) {
-            value = atomic_load(&(expected_head->buffer[idx])); 
+            value = atomic_load_explicit(&(expected_head->buffer[idx]), QUEUE_RELAXED);
 
             if (value == EMPTY_VALUE) {
                 //Queue empty.
@@ -202,6 +362,7 @@ bool BLQueue_is_empty(BLQueue* queue) {
             }
             else if (value == TAKEN_VALUE) {
                 //Someone popped a value in a meantime. Retrying. 
+                QUEUE_STAT_ADD(queue, empty_slot_retries, 1);
                 continue;
             }
             else {
@@ -212,22 +373,63 @@ bool BLQueue_is_empty(BLQueue* queue) {
 
         //Buffer empty. 
         else {
-            BLNode* next = atomic_load(&(expected_head->next)); 
+            BLNode* next = atomic_load_explicit(&(expected_head->next), QUEUE_ACQUIRE);
             if (next == NULL) {
                 //Queue empty. Finishing. 
                 finished = true;
             }
             else {
                 //Try to change the head.
-                if (atomic_compare_exchange_strong(&(queue->head), &expected_head, next)) {
+                if (atomic_compare_exchange_strong_explicit(&(queue->head), &expected_head, next, QUEUE_RELEASE, QUEUE_RELAXED)) {
                     //If success - retire the old head. 
-                    HazardPointer_retire(&queue->hp, expected_head);
+                    QUEUE_STAT_ADD(queue, head_advances, 1);
+                    QUEUE_TRACE_EVENT("head_advance", expected_head);
+                    HazardPointer_retire_with(handle, expected_head, expected_head->birth);
+                }
+                else {
+                    QUEUE_STAT_ADD(queue, cas_failures, 1);
+                    QUEUE_TRACE_EVENT("cas_fail", expected_head);
+                    BLQueue_back_off(queue, &backoff);
                 }
                 //Start again. 
             }
         }
     }
 
-    HazardPointer_clear(&(queue->hp));
+    QueueBackoff_end(&backoff);
+    HazardPointer_clear_with(handle, 0);
+    QUEUE_TRACE_END("BLQueue_is_empty");
     return value == EMPTY_VALUE;
 }
+
+void BLQueue_handle(BLQueue* queue, HazardPointer_Handle* handle) {
+    HazardPointer_handle(queue->hp, handle);
+}
+
+void BLQueue_set_backoff(BLQueue* queue, int policy) {
+    queue->backoff = policy;
+}
+
+void BLQueue_stats(BLQueue* queue, QueueStats* stats) {
+    QUEUE_STATS_COLLECT(queue, stats);
+}
+
+void BLQueue_hazard_stats(BLQueue* queue, HazardPointer_Stats* stats) {
+    HazardPointer_stats(queue->hp, stats);
+}
+
+void BLQueue_memory_usage(BLQueue* queue, QueueMemoryUsage* usage) {
+    size_t nodes = 0;
+    for (BLNode* node = atomic_load_explicit(&queue->head, QUEUE_ACQUIRE); node != NULL;
+         node = atomic_load_explicit(&node->next, QUEUE_ACQUIRE)) nodes++;
+
+    usage->node_bytes = nodes * sizeof(BLNode);
+    if (queue->owns_hp) {
+        HazardPointer_memory_usage(queue->hp, &usage->retired_bytes, &usage->overhead_bytes);
+        usage->overhead_bytes += sizeof(HazardPointer);
+    } else {
+        usage->retired_bytes = 0; //Accounted once for all queues by HazardPointer_memory_usage.
+        usage->overhead_bytes = 0;
+    }
+    usage->overhead_bytes += sizeof(BLQueue);
+}
@@ -2,15 +2,41 @@
 
 #include <stdbool.h>
 
+#include "QueueStats.h"
 #include "common.h"
 
+//Values per node; can be overridden at build time (CMake cache entry QUEUE_BUFFER_SIZE, see autotune.sh).
+#ifndef BUFFER_SIZE
 #define BUFFER_SIZE 1024
+#endif
 
 struct BLQueue;
 typedef struct BLQueue BLQueue;
+struct HazardPointer;
+struct HazardPointer_Stats;
+struct HazardPointer_Handle;
 
 BLQueue* BLQueue_new(void);
+//Creates a queue reclaiming its nodes with the given ReclamationScheme (see HazardPointer.h).
+BLQueue* BLQueue_new_with_scheme(int scheme);
+//Creates a queue reclaiming its nodes through hp (from HazardPointer_new), which other queues may share.
+//Deleting the queue leaves hp to the caller; its retired nodes are freed by later scans of hp.
+//Sets hp's node size (for the telemetry) if it has none yet.
+BLQueue* BLQueue_new_shared(struct HazardPointer* hp);
 void BLQueue_delete(BLQueue* queue);
 void BLQueue_push(BLQueue* queue, Value item);
 Value BLQueue_pop(BLQueue* queued);
 bool BLQueue_is_empty(BLQueue* queue);
+//Binds handle to the queue and the calling thread, for the *_with operations below.
+void BLQueue_handle(BLQueue* queue, struct HazardPointer_Handle* handle);
+//The operations above, with the calling thread's handle for this queue from BLQueue_handle.
+void BLQueue_push_with(BLQueue* queue, struct HazardPointer_Handle* handle, Value item);
+Value BLQueue_pop_with(BLQueue* queue, struct HazardPointer_Handle* handle);
+bool BLQueue_is_empty_with(BLQueue* queue, struct HazardPointer_Handle* handle);
+//Sets the QueueBackoffPolicy (see QueueBackoff.h) of the queue's retry loops, before threads use the queue.
+void BLQueue_set_backoff(BLQueue* queue, int policy);
+//Sums the contention counters of all threads; all zero unless built with QUEUE_STATS.
+void BLQueue_stats(BLQueue* queue, QueueStats* stats);
+void BLQueue_memory_usage(BLQueue* queue, QueueMemoryUsage* usage);
+//Reclamation telemetry of the queue's HazardPointer.
+void BLQueue_hazard_stats(BLQueue* queue, struct HazardPointer_Stats* stats);
@@ -1,146 +1,1029 @@
 #include <malloc.h>
+#include <pthread.h>
 #include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <threads.h>
 #include <assert.h>
+#ifdef QUEUE_MEMBARRIER
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 #include "HazardPointer.h"
+#include "QueueOrder.h"
+#include "QueueTrace.h"
+#include "Timing.h"
 
 thread_local int _thread_id = -1;
-int _num_threads = -1;
+static thread_local int _explicit_threads = 0; //num_threads of the thread's explicit registration, 0 if none.
+
+const char* ReclamationScheme_names[RECLAIM_NUM_SCHEMES] = { "hazard", "epoch", "qsbr", "eras" };
+
+int ReclamationScheme_find(const char* name) {
+    for (int i = 0; i < RECLAIM_NUM_SCHEMES; i++) {
+        if (strcmp(name, ReclamationScheme_names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+//Thread registry, shared by all HazardPointers. Ids are handed out densely (lowest free first) and scans
+//look at ids below thread_limit only, so their cost follows the number of threads alive, not ever seen.
+//An explicit registration reserves the ids below its num_threads until the thread registers again or exits.
+//Acquiring and releasing ids is rare and takes registry_lock; the hot paths only read thread_limit.
+#define ID_ACQUIRED -1
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static int* ids_used;            //Per id: ID_ACQUIRED, or the number of threads registered with it (0 if free).
+static int ids_capacity;
+static int* reservations;        //Per num_threads: live explicit registrations with it.
+static int reservations_capacity;
+static int explicit_limit;       //Largest num_threads of a live explicit registration.
+static _Atomic int thread_limit; //1 + highest id in use, at least explicit_limit.
+static HazardPointer* domains;   //Initialized HazardPointers.
+static pthread_key_t exit_key;   //Releases acquired ids at thread exit.
+static pthread_once_t exit_key_once = PTHREAD_ONCE_INIT;
+
+//Asymmetric fences (built with QUEUE_MEMBARRIER, used if the kernel supports private expedited membarrier):
+//protect publishes with a plain store and only a compiler barrier before re-reading, and scans instead run
+//membarrier, which executes a full fence on every running thread of the process before reading the
+//hazards. Either the protecting thread's store is then visible to the scan, or its re-read comes after
+//the unlink and sees the new value. Decided once, before the first HazardPointer is initialized.
+#ifdef QUEUE_MEMBARRIER
+static bool asymmetric_fence;
+#else
+static const bool asymmetric_fence = false;
+#endif
+static pthread_once_t fence_once = PTHREAD_ONCE_INIT;
+
+static void setup_fences(void) {
+#ifdef QUEUE_MEMBARRIER
+    long commands = syscall(SYS_membarrier, MEMBARRIER_CMD_QUERY, 0);
+    asymmetric_fence = commands >= 0 && (commands & MEMBARRIER_CMD_PRIVATE_EXPEDITED)
+                       && syscall(SYS_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0) == 0;
+#endif
+}
+
+bool HazardPointer_asymmetric_fences(void) {
+    pthread_once(&fence_once, setup_fences);
+    return asymmetric_fence;
+}
+
+//Memory orders (see QueueOrder.h). Protection is a store-load pattern on both sides: a reader publishes
+//a hazard (or an era or epoch) and then re-reads the pointer, a retiring thread unlinks the node and then
+//reads the hazards. A seq_cst fence after the publication and one before the scan (heavy_fence) make
+//sure that either the reader's re-read sees the unlink or the scan sees the hazard; the stores and the
+//unlink themselves need no more than release. With asymmetric fences membarrier stands in for both.
+//Hazards and eras are stored with release and read by scans with acquire, so a scan that sees a slot
+//cleared (or moved on) also sees the accesses the thread made before, and may free the node.
+//When the scan runs on another thread (orphans, the background reclaimer) the unlink reaches it through
+//the release CAS or store that hands the retired array over and the acquire exchange that adopts it.
+//The epoch/era clock and QSBR state stay seq_cst: their proofs order them against the unlinks and
+//announcements in one total order, and seq_cst loads cost the same as acquire ones on x86 and ARMv8.
+
+//Publishes a hazard pointer or era before re-reading what it protects.
+static inline void publish(_Atomic(void*)* hazard, _Atomic uint64_t* era, void* ptr, uint64_t value) {
+    memory_order order = asymmetric_fence ? memory_order_relaxed : QUEUE_RELEASE;
+    if (hazard) atomic_store_explicit(hazard, ptr, order);
+    else atomic_store_explicit(era, value, order);
+    if (asymmetric_fence) atomic_signal_fence(memory_order_seq_cst);
+    else atomic_thread_fence(memory_order_seq_cst);
+}
+
+//The scan side of publish: orders every thread's earlier publications before the hazards are read.
+static inline void heavy_fence(void) {
+#ifdef QUEUE_MEMBARRIER
+    if (asymmetric_fence) {
+        syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0);
+        return;
+    }
+#endif
+    atomic_thread_fence(memory_order_seq_cst);
+}
+
+//QSBR state is per process, not per queue: a quiescent thread holds no references into any queue.
+//A thread's qsbr is the global epoch it last saw while quiescent, 0 if it never was, or QSBR_OFFLINE.
+#define QSBR_OFFLINE UINT64_MAX
+typedef struct ThreadSlot {
+    _Alignas(64) _Atomic uint64_t qsbr;
+} ThreadSlot;
+static _Atomic uint64_t qsbr_epoch = 1;
+static _Atomic(ThreadSlot*) thread_chunks[HAZARD_MAX_CHUNKS];
+
+//Chunks are allocated by whichever thread needs them first; losers of the race free their copy.
+static ThreadSlot* thread_slot(int id) {
+    _Atomic(ThreadSlot*)* entry = &thread_chunks[id / HAZARD_CHUNK_SIZE];
+    ThreadSlot* chunk = atomic_load_explicit(entry, QUEUE_ACQUIRE);
+    if (chunk == NULL) {
+        ThreadSlot* fresh = (ThreadSlot*) aligned_alloc(_Alignof(ThreadSlot), HAZARD_CHUNK_SIZE * sizeof(ThreadSlot));
+        assert(fresh);
+        for (int i = 0; i < HAZARD_CHUNK_SIZE; i++) atomic_init(&fresh[i].qsbr, 0);
+        //Release publishes the initialized chunk; acquire on failure, as the winner's chunk is used.
+        if (atomic_compare_exchange_strong_explicit(entry, &chunk, fresh, QUEUE_ACQ_REL, QUEUE_ACQUIRE)) chunk = fresh;
+        else free(fresh);
+    }
+    return &chunk[id % HAZARD_CHUNK_SIZE];
+}
+
+static void init_record(HazardPointer_Record* record) {
+    for (int slot = 0; slot < HAZARD_SLOTS; slot++) {
+        atomic_init(&record->pointer[slot], NULL);
+        atomic_init(&record->era[slot], 0);
+    }
+    RetiredPointer_List* ret_ptr_list = &record->retired;
+    ret_ptr_list->pointers = NULL;
+    ret_ptr_list->size = 0;
+    ret_ptr_list->capacity = 0;
+    ret_ptr_list->scan_at = 0;
+    ret_ptr_list->scratch = NULL;
+    ret_ptr_list->scratch_capacity = 0;
+    ret_ptr_list->spare = NULL;
+    ret_ptr_list->spare_capacity = 0;
+    ret_ptr_list->batch_size = 0;
+    atomic_init(&ret_ptr_list->batch, NULL);
+    atomic_init(&ret_ptr_list->returned, NULL);
+    RetiredPointer_Stats* stats = &ret_ptr_list->stats;
+    atomic_init(&stats->retired, 0);
+    atomic_init(&stats->peak_retired, 0);
+    atomic_init(&stats->scans, 0);
+    atomic_init(&stats->fruitless_scans, 0);
+    atomic_init(&stats->freed, 0);
+    atomic_init(&stats->scan_cycles, 0);
+    atomic_init(&stats->max_scan_cycles, 0);
+    atomic_init(&stats->scan_threshold, 0);
+}
+
+//Directory entry of chunk c in hp. Without create, NULL if no id of its block used hp yet; with create, the
+//block is allocated like a chunk, by whichever thread needs it first.
+static _Atomic(HazardPointer_Record*)* chunk_entry(HazardPointer* hp, int c, bool create) {
+    if (c < HAZARD_DIRECTORY_BLOCK) return &hp->chunks[c]; //The first ids find their chunk with one load.
+    _Atomic(_Atomic(HazardPointer_Record*)*)* entry = &hp->blocks[c / HAZARD_DIRECTORY_BLOCK];
+    _Atomic(HazardPointer_Record*)* block = atomic_load_explicit(entry, QUEUE_ACQUIRE);
+    if (block == NULL) {
+        if (!create) return NULL;
+        _Atomic(HazardPointer_Record*)* fresh = (_Atomic(HazardPointer_Record*)*)
+            malloc(HAZARD_DIRECTORY_BLOCK * sizeof(_Atomic(HazardPointer_Record*)));
+        assert(fresh);
+        for (int i = 0; i < HAZARD_DIRECTORY_BLOCK; i++) atomic_init(&fresh[i], NULL);
+        if (atomic_compare_exchange_strong_explicit(entry, &block, fresh, QUEUE_ACQ_REL, QUEUE_ACQUIRE)) block = fresh;
+        else free(fresh);
+    }
+    return &block[c % HAZARD_DIRECTORY_BLOCK];
+}
+
+static HazardPointer_Record* chunk_at(HazardPointer* hp, int c) {
+    _Atomic(HazardPointer_Record*)* entry = chunk_entry(hp, c, false);
+    return entry ? atomic_load_explicit(entry, QUEUE_ACQUIRE) : NULL;
+}
+
+//Record of thread id in hp, or NULL if no thread of its chunk used hp yet.
+static HazardPointer_Record* find_record(HazardPointer* hp, int id) {
+    HazardPointer_Record* chunk = chunk_at(hp, id / HAZARD_CHUNK_SIZE);
+    return chunk ? &chunk[id % HAZARD_CHUNK_SIZE] : NULL;
+}
+
+static HazardPointer_Record* record_of(HazardPointer* hp, int id) {
+    _Atomic(HazardPointer_Record*)* entry = chunk_entry(hp, id / HAZARD_CHUNK_SIZE, true);
+    HazardPointer_Record* chunk = atomic_load_explicit(entry, QUEUE_ACQUIRE);
+    if (chunk == NULL) {
+        HazardPointer_Record* fresh = (HazardPointer_Record*) aligned_alloc(_Alignof(HazardPointer_Record),
+                                                                            HAZARD_CHUNK_SIZE * sizeof(HazardPointer_Record));
+        assert(fresh);
+        for (int i = 0; i < HAZARD_CHUNK_SIZE; i++) init_record(&fresh[i]);
+        if (atomic_compare_exchange_strong_explicit(entry, &chunk, fresh, QUEUE_ACQ_REL, QUEUE_ACQUIRE)) chunk = fresh;
+        else free(fresh);
+    }
+    return &chunk[id % HAZARD_CHUNK_SIZE];
+}
+
+static int own_id(void) {
+    int id = _thread_id;
+    return id >= 0 ? id : HazardPointer_acquire();
+}
+
+static HazardPointer_Record* own_record(HazardPointer* hp) {
+    return record_of(hp, own_id());
+}
+
+//Grows a registry array to hold index, the new entries zero. Must hold registry_lock.
+static void reserve_entries(int** entries, int* capacity, int index) {
+    if (index < *capacity) return;
+    int grown = *capacity > 0 ? 2 * *capacity : HAZARD_CHUNK_SIZE;
+    while (grown <= index) grown *= 2;
+    int* fresh = (int*) realloc(*entries, grown * sizeof(int));
+    assert(fresh);
+    memset(fresh + *capacity, 0, (grown - *capacity) * sizeof(int));
+    *entries = fresh;
+    *capacity = grown;
+}
+
+//Must hold registry_lock.
+static void update_thread_limit(void) {
+    while (explicit_limit > 0 && reservations[explicit_limit] == 0) explicit_limit--;
+    int limit = explicit_limit;
+    for (int id = ids_capacity - 1; id >= limit; id--) {
+        if (ids_used[id] != 0) {
+            limit = id + 1;
+            break;
+        }
+    }
+    atomic_store(&thread_limit, limit);
+}
+
+static void release_at_exit(void* value) {
+    (void)value;
+    HazardPointer_release();
+}
+
+static void create_exit_key(void) {
+    pthread_key_create(&exit_key, release_at_exit);
+}
+
+//Ends the calling thread's explicit registration, if any. Its record keeps its state for the next thread
+//registered with the id. Must hold registry_lock.
+static void unregister_explicit(void) {
+    if (_explicit_threads == 0) return;
+    ids_used[_thread_id]--;
+    reservations[_explicit_threads]--;
+    _explicit_threads = 0;
+}
 
 void HazardPointer_register(int thread_id, int num_threads) {
+    assert(thread_id >= 0 && thread_id < num_threads && num_threads <= HAZARD_MAX_THREADS);
+    pthread_once(&exit_key_once, create_exit_key);
+    if (_thread_id >= 0 && _explicit_threads == 0) HazardPointer_release(); //An acquired id.
+    pthread_mutex_lock(&registry_lock);
+    unregister_explicit();
+    reserve_entries(&ids_used, &ids_capacity, thread_id);
+    reserve_entries(&reservations, &reservations_capacity, num_threads);
+    if (ids_used[thread_id] == ID_ACQUIRED) {
+        fprintf(stderr, "HazardPointer: id %d is held by a thread that acquired it\n", thread_id);
+        abort();
+    }
+    ids_used[thread_id]++;
+    reservations[num_threads]++;
+    if (num_threads > explicit_limit) explicit_limit = num_threads;
+    update_thread_limit();
+    pthread_mutex_unlock(&registry_lock);
     _thread_id = thread_id;
-    _num_threads = num_threads;
+    _explicit_threads = num_threads;
+    //Online until its first quiescent state, see HazardPointer_quiescent.
+    atomic_store(&thread_slot(thread_id)->qsbr, 0);
+    pthread_setspecific(exit_key, (void*)1);
 }
 
-/*For each thread: creates and mallocs retired pointers list,
- initializes reserved pointer to NULL*/
-void HazardPointer_initialize(HazardPointer* hp) {
-    for (int i = 0; i < MAX_THREADS; i++) {
+int HazardPointer_acquire(void) {
+    pthread_once(&exit_key_once, create_exit_key);
+    pthread_mutex_lock(&registry_lock);
+    unregister_explicit();
+    int id = explicit_limit;
+    while (id < ids_capacity && ids_used[id] != 0) id++;
+    if (id >= HAZARD_MAX_THREADS) {
+        fprintf(stderr, "HazardPointer: more than %d threads registered\n", HAZARD_MAX_THREADS);
+        abort();
+    }
+    reserve_entries(&ids_used, &ids_capacity, id);
+    ids_used[id] = ID_ACQUIRED;
+    update_thread_limit();
+    pthread_mutex_unlock(&registry_lock);
+
+    _thread_id = id;
+    atomic_store(&thread_slot(id)->qsbr, 0);
+    pthread_setspecific(exit_key, (void*)1);
+    return id;
+}
+
+//Pushes the retired array of ret_ptr_list to hp's orphans, leaving the list empty.
+static void push_orphans(HazardPointer* hp, RetiredPointer_List* ret_ptr_list) {
+    if (ret_ptr_list->size == 0) return;
+    RetiredPointer_Orphans* orphans = (RetiredPointer_Orphans*) malloc(sizeof(RetiredPointer_Orphans));
+    assert(orphans);
+    orphans->pointers = ret_ptr_list->pointers;
+    orphans->size = ret_ptr_list->size;
+    atomic_fetch_add_explicit(&hp->orphaned, orphans->size, memory_order_relaxed); //A count only.
+    //Release publishes the array, and the unlinks of its nodes, to the thread that adopts it.
+    orphans->next = atomic_load_explicit(&hp->orphans, QUEUE_RELAXED);
+    while (!atomic_compare_exchange_weak_explicit(&hp->orphans, &orphans->next, orphans, QUEUE_RELEASE, QUEUE_RELAXED)) {}
 
-        //Initializing RetiredPointers Lists. 
-        RetiredPointer_List* ret_ptr_list = (RetiredPointer_List*) malloc(sizeof(RetiredPointer_List));
-        assert(ret_ptr_list);
-        ret_ptr_list->head = NULL;
-        ret_ptr_list->tail = NULL;
-        ret_ptr_list->size = 0;
-        hp->retired_ptrs[i] = ret_ptr_list;
+    ret_ptr_list->pointers = NULL;
+    ret_ptr_list->size = 0;
+    ret_ptr_list->capacity = 0;
+    atomic_store_explicit(&ret_ptr_list->stats.retired, 0, memory_order_relaxed);
+}
+
+//Moves the retired pointers of record to hp's orphans.
+static void hand_over(HazardPointer* hp, HazardPointer_Record* record) {
+    RetiredPointer_List* ret_ptr_list = &record->retired;
+    push_orphans(hp, ret_ptr_list);
+    free(ret_ptr_list->scratch);
+    ret_ptr_list->scratch = NULL;
+    ret_ptr_list->scratch_capacity = 0;
+    ret_ptr_list->scan_at = 0;
+}
 
-        //Initializing all protected addresses to NULL; 
-        atomic_init(&hp->pointer[i], NULL); 
+void HazardPointer_release(void) {
+    int id = _thread_id;
+    if (id < 0) return;
+    pthread_mutex_lock(&registry_lock);
+    for (HazardPointer* hp = domains; hp != NULL; hp = hp->next_domain) {
+        HazardPointer_Record* record = find_record(hp, id);
+        if (record == NULL) continue;
+        for (int slot = 0; slot < HAZARD_SLOTS; slot++) {
+            atomic_store_explicit(&record->pointer[slot], NULL, QUEUE_RELEASE);
+            atomic_store_explicit(&record->era[slot], 0, QUEUE_RELEASE);
+        }
+        hand_over(hp, record);
     }
+    if (_explicit_threads > 0) unregister_explicit();
+    else if (id < ids_capacity && ids_used[id] == ID_ACQUIRED) ids_used[id] = 0;
+    update_thread_limit();
+    pthread_mutex_unlock(&registry_lock);
+
+    atomic_store(&thread_slot(id)->qsbr, QSBR_OFFLINE);
+    _thread_id = -1;
+    pthread_once(&exit_key_once, create_exit_key);
+    pthread_setspecific(exit_key, NULL);
 }
 
-/*For each thread: free their retired ptrs, their retired ptrs list*/
+/*Initializes an empty HazardPointer; per-thread records are allocated by the first thread of each chunk
+ that uses it.*/
+void HazardPointer_initialize(HazardPointer* hp) {
+    pthread_once(&fence_once, setup_fences);
+    for (int c = 0; c < HAZARD_DIRECTORY_BLOCK; c++) atomic_init(&hp->chunks[c], NULL);
+    atomic_init(&hp->blocks[0], hp->chunks);
+    for (int b = 1; b < HAZARD_DIRECTORY_BLOCKS; b++) atomic_init(&hp->blocks[b], NULL);
+    hp->scheme = RECLAMATION_SCHEME;
+    atomic_init(&hp->clock, 1);
+    atomic_init(&hp->orphans, NULL);
+    atomic_init(&hp->orphaned, 0);
+    atomic_init(&hp->reclaimer, NULL);
+    hp->node_size = 0;
+    hp->retired_threshold = RETIRED_THRESHOLD;
+
+    pthread_mutex_lock(&registry_lock);
+    hp->prev_domain = NULL;
+    hp->next_domain = domains;
+    if (domains) domains->prev_domain = hp;
+    domains = hp;
+    pthread_mutex_unlock(&registry_lock);
+}
+
+/*Frees every retired pointer, orphans included, and the per-thread records*/
 void HazardPointer_finalize(HazardPointer* hp) {
-    for (int i = 0; i < MAX_THREADS; i++) {
-        RetiredPointer_List* ret_ptr_list = hp->retired_ptrs[i];
-        RetiredPointer_Node* curr_node = ret_ptr_list->head, *tmp = NULL; 
-        int counter = 0;
+    HazardPointer_stop_reclaimer(hp);
+    pthread_mutex_lock(&registry_lock);
+    if (hp->prev_domain) hp->prev_domain->next_domain = hp->next_domain;
+    else domains = hp->next_domain;
+    if (hp->next_domain) hp->next_domain->prev_domain = hp->prev_domain;
+    pthread_mutex_unlock(&registry_lock);
+
+    RetiredPointer_Orphans* orphans = atomic_exchange_explicit(&hp->orphans, NULL, QUEUE_ACQUIRE);
+    while (orphans != NULL) {
+        RetiredPointer_Orphans* next = orphans->next;
+        for (int j = 0; j < orphans->size; j++) free(orphans->pointers[j].pointer);
+        free(orphans->pointers);
+        free(orphans);
+        orphans = next;
+    }
+    atomic_store_explicit(&hp->orphaned, 0, memory_order_relaxed);
 
-        while (curr_node != NULL) {
-            tmp = curr_node->next;
-            free(curr_node->pointer);
-            curr_node->pointer = NULL;
-            free(curr_node);
-            curr_node = NULL;
-            curr_node = tmp; 
-            counter++;
+    for (int c = 0; c < HAZARD_MAX_CHUNKS; c++) {
+        HazardPointer_Record* chunk = chunk_at(hp, c);
+        if (chunk == NULL) continue;
+        for (int i = 0; i < HAZARD_CHUNK_SIZE; i++) {
+            RetiredPointer_List* ret_ptr_list = &chunk[i].retired;
+            for (int j = 0; j < ret_ptr_list->size; j++) free(ret_ptr_list->pointers[j].pointer);
+            free(ret_ptr_list->pointers);
+            free(ret_ptr_list->scratch);
+            //A batch handed over after the reclaimer stopped, and whichever of the arrays is spare.
+            RetiredPointer* batch = atomic_load_explicit(&ret_ptr_list->batch, QUEUE_ACQUIRE);
+            if (batch != NULL) {
+                for (int j = 0; j < ret_ptr_list->batch_size; j++) free(batch[j].pointer);
+                free(batch);
+            }
+            free(atomic_load_explicit(&ret_ptr_list->returned, QUEUE_ACQUIRE));
+            free(ret_ptr_list->spare);
         }
+        free(chunk);
+        atomic_store_explicit(chunk_entry(hp, c, false), NULL, QUEUE_RELAXED); //No thread uses hp any more.
+    }
+    for (int b = 1; b < HAZARD_DIRECTORY_BLOCKS; b++) {
+        free(atomic_load_explicit(&hp->blocks[b], QUEUE_RELAXED));
+        atomic_store_explicit(&hp->blocks[b], NULL, QUEUE_RELAXED);
+    }
+}
+
+HazardPointer* HazardPointer_new(ReclamationScheme scheme) {
+    HazardPointer* hp = (HazardPointer*)aligned_alloc(_Alignof(HazardPointer), sizeof(HazardPointer));
+    assert(hp);
+    HazardPointer_initialize(hp);
+    HazardPointer_set_scheme(hp, scheme);
+    return hp;
+}
+
+void HazardPointer_delete(HazardPointer* hp) {
+    HazardPointer_finalize(hp);
+    free(hp);
+}
+
+void HazardPointer_set_scheme(HazardPointer* hp, ReclamationScheme scheme) {
+    assert(scheme >= 0 && scheme < RECLAIM_NUM_SCHEMES);
+    hp->scheme = scheme;
+}
+
+//Relaxed: the object is published after this load, so any reader of it reads this era or a later one.
+uint64_t HazardPointer_era(HazardPointer* hp) {
+    return atomic_load_explicit(&hp->clock, QUEUE_RELAXED);
+}
 
-        //if (counter != ret_ptr_list->size) printf("HazardPointer_finalize: size wrong! Read: %d, should: %d\n", counter, ret_ptr_list->size);
+//seq_cst store: it must not be reordered with the thread's reads of nodes before or after it.
+void HazardPointer_quiescent(void) {
+    atomic_store_explicit(&thread_slot(own_id())->qsbr, atomic_load_explicit(&qsbr_epoch, memory_order_seq_cst), memory_order_seq_cst);
+}
+
+void HazardPointer_offline(void) {
+    atomic_store_explicit(&thread_slot(own_id())->qsbr, QSBR_OFFLINE, memory_order_seq_cst);
+}
 
-        free(ret_ptr_list);
-        ret_ptr_list = NULL;
+void HazardPointer_handle(HazardPointer* hp, HazardPointer_Handle* handle) {
+    handle->hp = hp;
+    handle->record = own_record(hp);
+}
+
+/*Protects a pointer in one of thread's slots. Returns the value of protected pointer.*/
+void* HazardPointer_protect_with(HazardPointer_Handle* handle, int slot, const _Atomic(void*)* atom) {
+    assert(slot >= 0 && slot < HAZARD_SLOTS);
+    HazardPointer_Record* record = handle->record;
+    switch (handle->hp->scheme) {
+        case RECLAIM_HAZARD: {
+            //Valid once the re-read after publishing returns the published pointer. The first read only
+            //guesses, the re-read is an acquire as the caller goes on to read the node.
+            _Atomic(void*)* hazard = &record->pointer[slot];
+            void* ptr = atomic_load_explicit(atom, QUEUE_RELAXED);
+            for (;;) {
+                publish(hazard, NULL, ptr, 0);
+                void* again = atomic_load_explicit(atom, QUEUE_ACQUIRE);
+                if (again == ptr) return ptr;
+                ptr = again;
+            }
+        }
+        case RECLAIM_EPOCH: {
+            //The first protect of an operation enters the current epoch; later ones are plain loads.
+            //The announcement is only read by its owner and scans, so a relaxed load checks it.
+            _Atomic uint64_t* announced = &record->era[0];
+            if (atomic_load_explicit(announced, memory_order_relaxed) == 0) {
+                publish(NULL, announced, NULL, atomic_load_explicit(&handle->hp->clock, memory_order_seq_cst));
+            }
+            return atomic_load_explicit(atom, QUEUE_ACQUIRE);
+        }
+        case RECLAIM_ERAS: {
+            //Re-publishes only when the era clock moved while reading, so a stable era costs two loads.
+            _Atomic uint64_t* published = &record->era[slot];
+            uint64_t prev = atomic_load_explicit(published, memory_order_relaxed);
+            for (;;) {
+                void* ptr = atomic_load_explicit(atom, QUEUE_ACQUIRE);
+                uint64_t era = atomic_load_explicit(&handle->hp->clock, memory_order_seq_cst);
+                if (era == prev) return ptr;
+                publish(NULL, published, NULL, era);
+                prev = era;
+            }
+        }
+        default:
+            return atomic_load_explicit(atom, QUEUE_ACQUIRE);
     }
 }
 
+void* HazardPointer_protect_slot(HazardPointer* hp, int slot, const _Atomic(void*)* atom) {
+    HazardPointer_Handle handle = { hp, own_record(hp) };
+    return HazardPointer_protect_with(&handle, slot, atom);
+}
+
 /*Protects a pointer (head or tail of the list). Returns the value of protected pointer.*/
 void* HazardPointer_protect(HazardPointer* hp, const _Atomic(void*)* atom) {
-    do {
-        atomic_store(&hp->pointer[_thread_id], atomic_load(atom));
-    } while (atomic_load(&hp->pointer[_thread_id]) != atomic_load(atom));
-    
-    return atomic_load(&hp->pointer[_thread_id]);
+    return HazardPointer_protect_slot(hp, 0, atom);
+}
+
+/*Removes a pointer from one of thread's slots*/
+void HazardPointer_clear_with(HazardPointer_Handle* handle, int slot) {
+    assert(slot >= 0 && slot < HAZARD_SLOTS);
+    HazardPointer_Record* record = handle->record;
+    switch (handle->hp->scheme) {
+        //Release: a scan that reads the cleared slot may free the node, after the thread's accesses to it.
+        case RECLAIM_HAZARD: atomic_store_explicit(&record->pointer[slot], NULL, QUEUE_RELEASE); break;
+        //Epoch keeps the operation's epoch until the last slot is cleared, see HazardPointer_clear.
+        case RECLAIM_EPOCH: if (slot == 0) atomic_store_explicit(&record->era[0], 0, QUEUE_RELEASE); break;
+        case RECLAIM_ERAS: atomic_store_explicit(&record->era[slot], 0, QUEUE_RELEASE); break;
+        default: break;
+    }
+}
+
+void HazardPointer_clear_all_with(HazardPointer_Handle* handle) {
+    for (int slot = 0; slot < HAZARD_SLOTS; slot++) HazardPointer_clear_with(handle, slot);
+}
+
+void HazardPointer_clear_slot(HazardPointer* hp, int slot) {
+    HazardPointer_Handle handle = { hp, own_record(hp) };
+    HazardPointer_clear_with(&handle, slot);
 }
 
 /*Removes a pointer from thread's protected pointer-value*/
 void HazardPointer_clear(HazardPointer* hp) {
-    atomic_store(&hp->pointer[_thread_id], NULL);  
+    HazardPointer_clear_slot(hp, 0);
 }
 
-RetiredPointer_Node* create_retired__node(void* ptr) {
-    RetiredPointer_Node* node = (RetiredPointer_Node*) malloc(sizeof(RetiredPointer_Node));
-    assert(node);
-    node->pointer = ptr;
-    node->next = NULL;
-    return node;
+void HazardPointer_clear_all(HazardPointer* hp) {
+    HazardPointer_Handle handle = { hp, own_record(hp) };
+    HazardPointer_clear_all_with(&handle);
 }
 
-void add_to_retired_list(HazardPointer* hp, void* ptr) {
-    RetiredPointer_List* ret_ptr_list = hp->retired_ptrs[_thread_id];
-    RetiredPointer_Node* new_node = create_retired__node(ptr); 
+//Grows the array only while the thread's scan threshold is larger than anything seen before.
+static void add_to_retired_list(HazardPointer* hp, RetiredPointer_List* ret_ptr_list, RetiredPointer retired) {
+    if (ret_ptr_list->size == ret_ptr_list->capacity) {
+        int capacity = ret_ptr_list->capacity > 0 ? 2 * ret_ptr_list->capacity : hp->retired_threshold + 1;
+        RetiredPointer* pointers = (RetiredPointer*) realloc(ret_ptr_list->pointers, capacity * sizeof(RetiredPointer));
+        assert(pointers);
+        ret_ptr_list->pointers = pointers;
+        ret_ptr_list->capacity = capacity;
+    }
+
+    ret_ptr_list->pointers[ret_ptr_list->size++] = retired;
+}
 
-    if (ret_ptr_list->tail == NULL) {
-        ret_ptr_list->head = new_node;
-        ret_ptr_list->tail = new_node;
+//Takes over the retired pointers of threads that released their ids.
+static void adopt_orphans(HazardPointer* hp, RetiredPointer_List* ret_ptr_list) {
+    RetiredPointer_Orphans* orphans = atomic_exchange_explicit(&hp->orphans, NULL, QUEUE_ACQUIRE);
+    while (orphans != NULL) {
+        RetiredPointer_Orphans* next = orphans->next;
+        for (int j = 0; j < orphans->size; j++) add_to_retired_list(hp, ret_ptr_list, orphans->pointers[j]);
+        atomic_fetch_sub_explicit(&hp->orphaned, orphans->size, memory_order_relaxed);
+        free(orphans->pointers);
+        free(orphans);
+        orphans = next;
     }
-    else {
-        ret_ptr_list->tail->next = new_node;
-        ret_ptr_list->tail = new_node;
+}
+
+static int compare_words(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+/*Copies every non-zero hazard pointer (or, with eras set, published era) of the threads below limit into
+ words, sorted. Returns their number.*/
+static int snapshot(HazardPointer* hp, int limit, bool eras, uint64_t* words) {
+    int count = 0;
+    for (int c = 0; c * HAZARD_CHUNK_SIZE < limit; c++) {
+        HazardPointer_Record* chunk = chunk_at(hp, c);
+        if (chunk == NULL) continue;
+        int n = limit - c * HAZARD_CHUNK_SIZE < HAZARD_CHUNK_SIZE ? limit - c * HAZARD_CHUNK_SIZE : HAZARD_CHUNK_SIZE;
+        for (int i = 0; i < n; i++) {
+            for (int slot = 0; slot < HAZARD_SLOTS; slot++) {
+                uint64_t word = eras ? atomic_load_explicit(&chunk[i].era[slot], QUEUE_ACQUIRE)
+                                     : (uintptr_t)atomic_load_explicit(&chunk[i].pointer[slot], QUEUE_ACQUIRE);
+                if (word != 0) words[count++] = word;
+            }
+        }
+    }
+    qsort(words, count, sizeof(uint64_t), compare_words);
+    return count;
+}
+
+/*Returns true if ptr is not among the sorted hazards.*/
+static bool can_free_node(const uint64_t* hazards, int count, void* ptr) {
+    uint64_t key = (uintptr_t)ptr;
+    return bsearch(&key, hazards, count, sizeof(uint64_t), compare_words) == NULL;
+}
+
+/*Returns true if no era among the sorted eras lies in [birth, retired].*/
+static bool era_free(const uint64_t* eras, int count, uint64_t birth, uint64_t retired) {
+    //First era >= birth.
+    int lo = 0, hi = count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (eras[mid] < birth) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo == count || eras[lo] > retired;
+}
+
+/*Advances the epoch past e once every thread below limit is outside any operation or inside epoch e.
+ Returns the epoch after the attempt.*/
+static uint64_t try_advance_epoch(HazardPointer* hp, int limit) {
+    uint64_t e = atomic_load_explicit(&hp->clock, memory_order_seq_cst);
+    for (int id = 0; id < limit; id++) {
+        HazardPointer_Record* record = find_record(hp, id);
+        if (record == NULL) {
+            id += HAZARD_CHUNK_SIZE - 1 - id % HAZARD_CHUNK_SIZE;
+            continue;
+        }
+        uint64_t announced = atomic_load_explicit(&record->era[0], QUEUE_ACQUIRE);
+        if (announced != 0 && announced != e) return e;
+    }
+    atomic_compare_exchange_strong_explicit(&hp->clock, &e, e + 1, memory_order_seq_cst, memory_order_seq_cst);
+    return atomic_load_explicit(&hp->clock, memory_order_seq_cst);
+}
+
+/*Advances the QSBR epoch past e once every thread below limit has been quiescent in e or is offline.*/
+static uint64_t try_advance_qsbr(int limit) {
+    uint64_t e = atomic_load_explicit(&qsbr_epoch, memory_order_seq_cst);
+    for (int id = 0; id < limit; id++) {
+        ThreadSlot* chunk = atomic_load_explicit(&thread_chunks[id / HAZARD_CHUNK_SIZE], QUEUE_ACQUIRE);
+        if (chunk == NULL) {
+            id += HAZARD_CHUNK_SIZE - 1 - id % HAZARD_CHUNK_SIZE;
+            continue;
+        }
+        uint64_t local = atomic_load_explicit(&chunk[id % HAZARD_CHUNK_SIZE].qsbr, memory_order_seq_cst);
+        if (local != QSBR_OFFLINE && local != e) return e;
+    }
+    atomic_compare_exchange_strong_explicit(&qsbr_epoch, &e, e + 1, memory_order_seq_cst, memory_order_seq_cst);
+    return atomic_load_explicit(&qsbr_epoch, memory_order_seq_cst);
+}
+
+//Frees node not used by any other thread from retired pointers list, keeping the rest in order.
+//Hazard pointers: the hazards are read once, so a scan costs O(H log H + R log H) for H hazards and R
+//retired pointers. Epoch and QSBR: a node retired in epoch e is free once the epoch reached e + 2, as
+//every thread has since left the operation that could have seen it. Hazard eras: a node is free if no
+//thread published an era between its birth and its retirement.
+//Only threads below thread_limit are looked at; ids are dense, so that is about the threads alive.
+static void clean_retired_list(HazardPointer* hp, RetiredPointer_List* ret_ptr_list) {
+    //seq_cst, like the stores of registration: a thread registered after this load may not be missed by QSBR.
+    int limit = atomic_load_explicit(&thread_limit, memory_order_seq_cst);
+    int count = 0;
+    uint64_t epoch = 0;
+    if (hp->scheme != RECLAIM_QSBR) heavy_fence();
+    if (hp->scheme == RECLAIM_HAZARD || hp->scheme == RECLAIM_ERAS) {
+        if (ret_ptr_list->scratch_capacity < limit * HAZARD_SLOTS) {
+            free(ret_ptr_list->scratch);
+            ret_ptr_list->scratch_capacity = limit * HAZARD_SLOTS;
+            ret_ptr_list->scratch = (uint64_t*) malloc(ret_ptr_list->scratch_capacity * sizeof(uint64_t));
+            assert(ret_ptr_list->scratch);
+        }
+        count = snapshot(hp, limit, hp->scheme == RECLAIM_ERAS, ret_ptr_list->scratch);
+    }
+    else if (hp->scheme == RECLAIM_EPOCH) epoch = try_advance_epoch(hp, limit);
+    else epoch = try_advance_qsbr(limit);
+
+    int kept = 0;
+    for (int i = 0; i < ret_ptr_list->size; i++) {
+        RetiredPointer r = ret_ptr_list->pointers[i];
+        bool can_free;
+        switch (hp->scheme) {
+            case RECLAIM_HAZARD: can_free = can_free_node(ret_ptr_list->scratch, count, r.pointer); break;
+            case RECLAIM_ERAS: can_free = era_free(ret_ptr_list->scratch, count, r.birth, r.retired); break;
+            default: can_free = r.retired + 2 <= epoch; break;
+        }
+        if (can_free) free(r.pointer);
+        else ret_ptr_list->pointers[kept++] = r;
     }
+    ret_ptr_list->size = kept;
+}
 
-    ret_ptr_list->size++;
+//Telemetry counters have a single writer, so a relaxed load and store is enough to bump them.
+static inline void stat_add(_Atomic uint64_t* counter, uint64_t n) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+static inline void stat_max(_Atomic uint64_t* counter, uint64_t value) {
+    if (value > atomic_load_explicit(counter, memory_order_relaxed)) {
+        atomic_store_explicit(counter, value, memory_order_relaxed);
+    }
 }
 
-/*Returns true if any of thread is currently in use of this pointer.*/
-bool can_free_node(HazardPointer* hp, void* ptr) {
-    for (int i = 0; i < _num_threads; i++) {
-        if (atomic_load(&hp->pointer[i]) == ptr) return false;
+//Retired list size that triggers a scan: the configured threshold, but at least twice the number of
+//hazards. A scan then frees at least half of the list, so reclamation costs amortised O(log H) per
+//retire and no thread holds more than the threshold of garbage.
+static int scan_threshold(const HazardPointer* hp) {
+    int hazards = atomic_load_explicit(&thread_limit, memory_order_relaxed) * HAZARD_SLOTS;
+    return hp->retired_threshold > 2 * hazards ? hp->retired_threshold : 2 * hazards;
+}
+
+//Moves the entries of the batch that owner handed over into ret_ptr_list and gives the array back to owner.
+//Called by the reclaimer, or by owner itself once the reclaimer is gone.
+static void take_batch(HazardPointer* hp, RetiredPointer_List* owner, RetiredPointer_List* ret_ptr_list) {
+    if (atomic_load_explicit(&owner->batch, QUEUE_RELAXED) == NULL) return;
+    RetiredPointer* batch = atomic_exchange_explicit(&owner->batch, NULL, QUEUE_ACQUIRE);
+    if (batch == NULL) return;
+    int size = owner->batch_size;
+    for (int j = 0; j < size; j++) add_to_retired_list(hp, ret_ptr_list, batch[j]);
+    atomic_fetch_sub_explicit(&hp->orphaned, size, memory_order_relaxed);
+    //Release: the reads of the array above happen before owner reuses it.
+    atomic_store_explicit(&owner->returned, batch, QUEUE_RELEASE);
+}
+
+//Takes the batches of every record of hp into ret_ptr_list.
+static void collect_batches(HazardPointer* hp, RetiredPointer_List* ret_ptr_list) {
+    for (int b = 0; b < HAZARD_DIRECTORY_BLOCKS; b++) {
+        _Atomic(HazardPointer_Record*)* block = atomic_load_explicit(&hp->blocks[b], QUEUE_ACQUIRE);
+        if (block == NULL) continue;
+        for (int c = 0; c < HAZARD_DIRECTORY_BLOCK; c++) {
+            HazardPointer_Record* chunk = atomic_load_explicit(&block[c], QUEUE_ACQUIRE);
+            if (chunk == NULL) continue;
+            for (int i = 0; i < HAZARD_CHUNK_SIZE; i++) take_batch(hp, &chunk[i].retired, ret_ptr_list);
+        }
     }
+}
+
+//Publishes the full array of ret_ptr_list as its batch and continues in the spare array. Returns false,
+//handing nothing over, while the previous batch is still with the reclaimer.
+static bool hand_off(HazardPointer* hp, RetiredPointer_List* ret_ptr_list) {
+    if (ret_ptr_list->spare == NULL) {
+        ret_ptr_list->spare = atomic_exchange_explicit(&ret_ptr_list->returned, NULL, QUEUE_ACQUIRE);
+        if (ret_ptr_list->spare == NULL) {
+            if (ret_ptr_list->spare_capacity > 0) return false;
+            //First hand-off of the list: its second array.
+            ret_ptr_list->spare_capacity = ret_ptr_list->capacity;
+            ret_ptr_list->spare = (RetiredPointer*) malloc(ret_ptr_list->spare_capacity * sizeof(RetiredPointer));
+            assert(ret_ptr_list->spare);
+        }
+    }
+    //The spare came back, so the reclaimer took the last batch and the slot is empty.
+    ret_ptr_list->batch_size = ret_ptr_list->size;
+    atomic_fetch_add_explicit(&hp->orphaned, ret_ptr_list->size, memory_order_relaxed); //A count only.
+    //Release publishes the array, and the unlinks of its nodes, to the reclaimer.
+    atomic_store_explicit(&ret_ptr_list->batch, ret_ptr_list->pointers, QUEUE_RELEASE);
+
+    int capacity = ret_ptr_list->capacity;
+    ret_ptr_list->pointers = ret_ptr_list->spare;
+    ret_ptr_list->capacity = ret_ptr_list->spare_capacity;
+    ret_ptr_list->spare = NULL;
+    ret_ptr_list->spare_capacity = capacity;
+    ret_ptr_list->size = 0;
     return true;
 }
 
-//Frees node not used by any other thread from retired pointers list.
-void clean_retired_list(HazardPointer* hp) {
-    RetiredPointer_Node *curr = hp->retired_ptrs[_thread_id]->head, *prev = NULL, *next = NULL; 
+//Adopts orphans and scans ret_ptr_list, recording the scan in its telemetry.
+static void scan(HazardPointer* hp, RetiredPointer_List* ret_ptr_list) {
+    RetiredPointer_Stats* stats = &ret_ptr_list->stats;
+    if (atomic_load_explicit(&hp->orphans, memory_order_relaxed) != NULL) adopt_orphans(hp, ret_ptr_list);
+    int before = ret_ptr_list->size;
+    QUEUE_TRACE_BEGIN("scan");
+    uint64_t start = Timing_cycles();
+    clean_retired_list(hp, ret_ptr_list);
+    uint64_t cycles = Timing_cycles() - start;
+    QUEUE_TRACE_END("scan");
 
-    //if (curr == NULL) printf("Clean_retired_list:, head should not be null!\n");
-    //if (hp->retired_ptrs[_thread_id]->size != RETIRED_THRESHOLD) printf("Clean_retired_list: list-size should be: %d, is: %d\n", RETIRED_THRESHOLD, hp->retired_ptrs[_thread_id]->size);
+    int freed = before - ret_ptr_list->size;
+    stat_add(&stats->scans, 1);
+    stat_add(&stats->freed, freed);
+    if (freed == 0) stat_add(&stats->fruitless_scans, 1);
+    stat_add(&stats->scan_cycles, cycles);
+    stat_max(&stats->max_scan_cycles, cycles);
+    ret_ptr_list->scan_at = 2 * ret_ptr_list->size;
+}
 
-    while (curr != NULL) {
-        next = curr->next;
-        
-        if (can_free_node(hp, curr)) {
-            hp->retired_ptrs[_thread_id]->size--;
-            
-            if (prev == NULL) hp->retired_ptrs[_thread_id]->head = next; 
-            else prev->next = next;
+//State of a background reclaimer. Retiring threads hand full retired arrays over through the batch slots
+//of their lists, which need no lock; lock only guards sleeping and waking, so it is taken on backpressure alone.
+typedef struct HazardPointer_Reclaimer {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;    //Scan now (backpressure) or stop.
+    pthread_cond_t scanned; //Broadcast after every scan.
+    long interval_ns;
+    size_t high_watermark;
+    uint64_t rounds; //Finished scans.
+    bool scanning;
+    bool urgent;
+    bool stop;
+    RetiredPointer_List retired; //Adopted pointers that could not be freed yet.
+} HazardPointer_Reclaimer;
 
-            free(curr->pointer);
-            curr->pointer = NULL;
-            free(curr);
-            curr = next;
+//Retired pointers waiting for the reclaimer.
+static size_t reclaimer_pending(HazardPointer* hp, HazardPointer_Reclaimer* reclaimer) {
+    return atomic_load_explicit(&hp->orphaned, memory_order_relaxed)
+           + atomic_load_explicit(&reclaimer->retired.stats.retired, memory_order_relaxed);
+}
+
+static void* reclaimer_main(void* arg) {
+    HazardPointer* hp = (HazardPointer*)arg;
+    HazardPointer_Reclaimer* reclaimer = atomic_load_explicit(&hp->reclaimer, QUEUE_ACQUIRE);
+    RetiredPointer_List* ret_ptr_list = &reclaimer->retired;
+    pthread_mutex_lock(&reclaimer->lock);
+    while (!reclaimer->stop) {
+        if (!reclaimer->urgent) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_nsec += reclaimer->interval_ns;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+            deadline.tv_nsec %= 1000000000L;
+            pthread_cond_timedwait(&reclaimer->wake, &reclaimer->lock, &deadline);
+            if (reclaimer->stop) break;
         }
+        reclaimer->urgent = false;
+        reclaimer->scanning = true;
+        pthread_mutex_unlock(&reclaimer->lock);
+
+        collect_batches(hp, ret_ptr_list);
+        scan(hp, ret_ptr_list);
+        atomic_store_explicit(&ret_ptr_list->stats.retired, ret_ptr_list->size, memory_order_relaxed);
+        stat_max(&ret_ptr_list->stats.peak_retired, ret_ptr_list->size);
+
+        pthread_mutex_lock(&reclaimer->lock);
+        reclaimer->scanning = false;
+        reclaimer->rounds++;
+        pthread_cond_broadcast(&reclaimer->scanned);
+    }
+    pthread_mutex_unlock(&reclaimer->lock);
+    return NULL;
+}
+
+//Waits for one scan that started after the caller's hand-off, or less if pending drops below the
+//high watermark. Never longer: the waiting thread may itself hold back what the scan could free.
+static void reclaimer_backpressure(HazardPointer* hp, HazardPointer_Reclaimer* reclaimer) {
+    if (reclaimer->high_watermark == 0 || reclaimer_pending(hp, reclaimer) <= reclaimer->high_watermark) return;
+    QUEUE_TRACE_BEGIN("backpressure");
+    pthread_mutex_lock(&reclaimer->lock);
+    uint64_t until = reclaimer->rounds + (reclaimer->scanning ? 2 : 1);
+    reclaimer->urgent = true;
+    pthread_cond_signal(&reclaimer->wake);
+    while (!reclaimer->stop && reclaimer->rounds < until
+           && reclaimer_pending(hp, reclaimer) > reclaimer->high_watermark) {
+        pthread_cond_wait(&reclaimer->scanned, &reclaimer->lock);
+    }
+    pthread_mutex_unlock(&reclaimer->lock);
+    QUEUE_TRACE_END("backpressure");
+}
+
+void HazardPointer_start_reclaimer(HazardPointer* hp, long interval_us, size_t high_watermark) {
+    if (atomic_load_explicit(&hp->reclaimer, QUEUE_RELAXED) != NULL) return;
+    HazardPointer_Reclaimer* reclaimer = (HazardPointer_Reclaimer*) aligned_alloc(_Alignof(HazardPointer_Reclaimer), sizeof(HazardPointer_Reclaimer));
+    assert(reclaimer);
+    memset(reclaimer, 0, sizeof(HazardPointer_Reclaimer));
+    pthread_mutex_init(&reclaimer->lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&reclaimer->wake, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_cond_init(&reclaimer->scanned, NULL);
+    reclaimer->interval_ns = (interval_us > 0 ? interval_us : 1) * 1000L;
+    reclaimer->high_watermark = high_watermark;
 
-        else {
-            prev = curr;
-            curr = next; 
+    atomic_store_explicit(&hp->reclaimer, reclaimer, QUEUE_RELEASE); //Publishes the initialized reclaimer.
+    int err = pthread_create(&reclaimer->thread, NULL, reclaimer_main, hp);
+    assert(err == 0);
+    (void)err;
+}
+
+void HazardPointer_stop_reclaimer(HazardPointer* hp) {
+    HazardPointer_Reclaimer* reclaimer = atomic_load_explicit(&hp->reclaimer, QUEUE_RELAXED);
+    if (reclaimer == NULL) return;
+    pthread_mutex_lock(&reclaimer->lock);
+    reclaimer->stop = true;
+    pthread_cond_signal(&reclaimer->wake);
+    pthread_cond_broadcast(&reclaimer->scanned);
+    pthread_mutex_unlock(&reclaimer->lock);
+    pthread_join(reclaimer->thread, NULL);
+    atomic_store_explicit(&hp->reclaimer, NULL, QUEUE_RELAXED);
+
+    collect_batches(hp, &reclaimer->retired);
+    push_orphans(hp, &reclaimer->retired);
+    free(reclaimer->retired.pointers); //Left only if empty.
+    free(reclaimer->retired.scratch);
+    pthread_cond_destroy(&reclaimer->wake);
+    pthread_cond_destroy(&reclaimer->scanned);
+    pthread_mutex_destroy(&reclaimer->lock);
+    free(reclaimer);
+}
+
+//Epoch and QSBR scans free nothing while one thread stalls the epoch; scanning again only once the list
+//doubled keeps their cost amortised O(1) per retire.
+//With a background reclaimer, a full retired array is handed over instead and the retire neither scans nor frees,
+//unless the reclaimer has not taken the previous array yet even after backpressure; the retire then scans.
+void HazardPointer_retire_with(HazardPointer_Handle* handle, void* ptr, uint64_t birth_era) {
+    HazardPointer* hp = handle->hp;
+    RetiredPointer_List* ret_ptr_list = &handle->record->retired;
+    RetiredPointer_Stats* stats = &ret_ptr_list->stats;
+    QUEUE_TRACE_EVENT("retire", ptr);
+    uint64_t stamp = atomic_load_explicit(hp->scheme == RECLAIM_QSBR ? &qsbr_epoch : &hp->clock, memory_order_seq_cst);
+    HazardPointer_Reclaimer* reclaimer = atomic_load_explicit(&hp->reclaimer, QUEUE_ACQUIRE);
+    if (reclaimer != NULL) {
+        if (ret_ptr_list->size >= hp->retired_threshold) {
+            atomic_store_explicit(&stats->scan_threshold, hp->retired_threshold, memory_order_relaxed);
+            bool handed = hand_off(hp, ret_ptr_list);
+            reclaimer_backpressure(hp, reclaimer);
+            if (!handed && !hand_off(hp, ret_ptr_list)) scan(hp, ret_ptr_list);
         }
     }
+    else {
+        int threshold = scan_threshold(hp);
+        if (ret_ptr_list->scan_at > threshold) threshold = ret_ptr_list->scan_at;
+        //Too many ptrs on retired list - list should be cleaned.
+        if (ret_ptr_list->size >= threshold) {
+            atomic_store_explicit(&stats->scan_threshold, threshold, memory_order_relaxed);
+            take_batch(hp, ret_ptr_list, ret_ptr_list); //Handed over while the reclaimer was stopping.
+            scan(hp, ret_ptr_list);
+        }
+    }
+    add_to_retired_list(hp, ret_ptr_list, (RetiredPointer){ ptr, birth_era, stamp });
+    //Hazard eras: a new era per retire, unless another thread already started one.
+    if (hp->scheme == RECLAIM_ERAS) {
+        atomic_compare_exchange_strong_explicit(&hp->clock, &stamp, stamp + 1, memory_order_seq_cst, memory_order_seq_cst);
+    }
+    atomic_store_explicit(&stats->retired, ret_ptr_list->size, memory_order_relaxed);
+    stat_max(&stats->peak_retired, ret_ptr_list->size);
+}
 
-    hp->retired_ptrs[_thread_id]->tail = prev; 
+void HazardPointer_retire_born(HazardPointer* hp, void* ptr, uint64_t birth_era) {
+    HazardPointer_Handle handle = { hp, own_record(hp) };
+    HazardPointer_retire_with(&handle, ptr, birth_era);
 }
 
 void HazardPointer_retire(HazardPointer* hp, void* ptr) {
-    RetiredPointer_List* ret_ptr_list = hp->retired_ptrs[_thread_id];
-    if (ret_ptr_list->size == RETIRED_THRESHOLD) {
-        //Too many ptrs on retired list - list should be cleaned. 
-        clean_retired_list(hp);
+    HazardPointer_retire_born(hp, ptr, 0);
+}
+
+void HazardPointer_set_retired_threshold(HazardPointer* hp, int threshold) {
+    hp->retired_threshold = threshold;
+}
+
+void HazardPointer_set_node_size(HazardPointer* hp, size_t node_size) {
+    hp->node_size = node_size;
+}
+
+void HazardPointer_stats(HazardPointer* hp, HazardPointer_Stats* stats) {
+    HazardPointer_ThreadStats* total = &stats->total;
+    *total = (HazardPointer_ThreadStats){ 0 };
+    for (int i = 0; i < MAX_THREADS; i++) stats->threads[i] = (HazardPointer_ThreadStats){ 0 };
+    stats->num_threads = 0;
+    uint64_t sum_of_peaks = 0;
+
+    for (int c = 0; c < HAZARD_MAX_CHUNKS; c++) {
+        HazardPointer_Record* chunk = chunk_at(hp, c);
+        if (chunk == NULL) continue;
+        for (int i = 0; i < HAZARD_CHUNK_SIZE; i++) {
+            RetiredPointer_Stats* src = &chunk[i].retired.stats;
+            HazardPointer_ThreadStats t;
+            t.retired = atomic_load_explicit(&src->retired, memory_order_relaxed);
+            t.peak_retired = atomic_load_explicit(&src->peak_retired, memory_order_relaxed);
+            t.scans = atomic_load_explicit(&src->scans, memory_order_relaxed);
+            t.fruitless_scans = atomic_load_explicit(&src->fruitless_scans, memory_order_relaxed);
+            t.freed = atomic_load_explicit(&src->freed, memory_order_relaxed);
+            t.scan_cycles = atomic_load_explicit(&src->scan_cycles, memory_order_relaxed);
+            t.max_scan_cycles = atomic_load_explicit(&src->max_scan_cycles, memory_order_relaxed);
+            t.scan_threshold = atomic_load_explicit(&src->scan_threshold, memory_order_relaxed);
+            int id = c * HAZARD_CHUNK_SIZE + i;
+            if (id < MAX_THREADS) stats->threads[id] = t;
+            if (t.peak_retired > 0) stats->num_threads = id + 1;
+
+            total->retired += t.retired;
+            total->scans += t.scans;
+            total->fruitless_scans += t.fruitless_scans;
+            total->freed += t.freed;
+            total->scan_cycles += t.scan_cycles;
+            if (t.peak_retired > total->peak_retired) total->peak_retired = t.peak_retired;
+            if (t.max_scan_cycles > total->max_scan_cycles) total->max_scan_cycles = t.max_scan_cycles;
+            if (t.scan_threshold > total->scan_threshold) total->scan_threshold = t.scan_threshold;
+            sum_of_peaks += t.peak_retired;
+        }
+    }
+    uint64_t orphaned = atomic_load_explicit(&hp->orphaned, memory_order_relaxed);
+    total->retired += orphaned;
+    HazardPointer_Reclaimer* reclaimer = atomic_load_explicit(&hp->reclaimer, QUEUE_ACQUIRE);
+    if (reclaimer != NULL) {
+        RetiredPointer_Stats* src = &reclaimer->retired.stats;
+        uint64_t retired = atomic_load_explicit(&src->retired, memory_order_relaxed);
+        uint64_t peak = atomic_load_explicit(&src->peak_retired, memory_order_relaxed);
+        uint64_t max_scan_cycles = atomic_load_explicit(&src->max_scan_cycles, memory_order_relaxed);
+        total->retired += retired;
+        total->scans += atomic_load_explicit(&src->scans, memory_order_relaxed);
+        total->fruitless_scans += atomic_load_explicit(&src->fruitless_scans, memory_order_relaxed);
+        total->freed += atomic_load_explicit(&src->freed, memory_order_relaxed);
+        total->scan_cycles += atomic_load_explicit(&src->scan_cycles, memory_order_relaxed);
+        if (peak > total->peak_retired) total->peak_retired = peak;
+        if (max_scan_cycles > total->max_scan_cycles) total->max_scan_cycles = max_scan_cycles;
+        sum_of_peaks += peak;
+    }
+
+    stats->truncated = stats->num_threads > MAX_THREADS;
+    stats->bytes_pinned = total->retired * hp->node_size;
+    stats->peak_bytes_pinned = (sum_of_peaks + orphaned) * hp->node_size;
+    stats->freed_per_scan = total->scans > 0 ? (double)total->freed / total->scans : 0.0;
+}
+
+void HazardPointer_memory_usage(HazardPointer* hp, size_t* retired_bytes, size_t* overhead_bytes) {
+    uint64_t retired = atomic_load_explicit(&hp->orphaned, memory_order_relaxed);
+    size_t overhead = 0;
+    for (int b = 1; b < HAZARD_DIRECTORY_BLOCKS; b++) {
+        if (atomic_load_explicit(&hp->blocks[b], QUEUE_RELAXED)) overhead += HAZARD_DIRECTORY_BLOCK * sizeof(void*);
+    }
+    for (int c = 0; c < HAZARD_MAX_CHUNKS; c++) {
+        HazardPointer_Record* chunk = chunk_at(hp, c);
+        if (chunk == NULL) continue;
+        overhead += HAZARD_CHUNK_SIZE * sizeof(HazardPointer_Record);
+        for (int i = 0; i < HAZARD_CHUNK_SIZE; i++) {
+            RetiredPointer_List* ret_ptr_list = &chunk[i].retired;
+            retired += atomic_load_explicit(&ret_ptr_list->stats.retired, memory_order_relaxed);
+            overhead += (ret_ptr_list->capacity + ret_ptr_list->spare_capacity) * sizeof(RetiredPointer)
+                        + ret_ptr_list->scratch_capacity * sizeof(uint64_t);
+        }
+    }
+    HazardPointer_Reclaimer* reclaimer = atomic_load_explicit(&hp->reclaimer, QUEUE_ACQUIRE);
+    if (reclaimer != NULL) {
+        retired += atomic_load_explicit(&reclaimer->retired.stats.retired, memory_order_relaxed);
+        overhead += sizeof(HazardPointer_Reclaimer);
     }
-    add_to_retired_list(hp, ptr);
+    *retired_bytes = retired * hp->node_size;
+    *overhead_bytes = overhead;
 }
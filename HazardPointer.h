@@ -1,36 +1,227 @@
 #pragma once
 
 #include <stdatomic.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
+//Threads whose telemetry HazardPointer_Stats reports one by one (the others only count in its totals),
+//and the default retired threshold. The benchmarks size their per-thread state by the run.
+//Not a limit of HazardPointer itself, see HAZARD_MAX_THREADS.
 #define MAX_THREADS 128
-static const int RETIRED_THRESHOLD = MAX_THREADS;
+//Per-thread state is allocated in chunks of HAZARD_CHUNK_SIZE threads when a thread with an id in the
+//chunk first uses a HazardPointer, so a HazardPointer only grows with the threads that actually use it.
+//The directory of chunks holds the first HAZARD_DIRECTORY_BLOCK of them inline; the others are found
+//through blocks of as many entries, allocated when the first id they cover uses the HazardPointer.
+#define HAZARD_CHUNK_SIZE 64
+#ifndef HAZARD_MAX_CHUNKS
+#define HAZARD_MAX_CHUNKS 1024
+#endif
+#define HAZARD_DIRECTORY_BLOCK 16
+#define HAZARD_DIRECTORY_BLOCKS ((HAZARD_MAX_CHUNKS + HAZARD_DIRECTORY_BLOCK - 1) / HAZARD_DIRECTORY_BLOCK)
+//Most threads registered at the same time.
+#define HAZARD_MAX_THREADS (HAZARD_CHUNK_SIZE * HAZARD_MAX_CHUNKS)
+//Default retired list size that triggers a scan; can be overridden at build time
+//(CMake cache entry QUEUE_RETIRED_THRESHOLD, see autotune.sh) or per queue with HazardPointer_set_retired_threshold.
+#ifndef RETIRED_THRESHOLD
+#define RETIRED_THRESHOLD MAX_THREADS
+#endif
+//Hazard slots per thread, so that a thread can protect e.g. a node and its successor at once.
+#ifndef HAZARD_SLOTS
+#define HAZARD_SLOTS 2
+#endif
 
-typedef struct RetiredPointer_Node {
+//How retired objects are proven unreachable. All schemes sit behind the same protect/clear/retire calls.
+typedef enum {
+    RECLAIM_HAZARD, //Hazard pointers: protect publishes the pointer and re-reads it to validate.
+    RECLAIM_EPOCH,  //Epoch-based: the first protect of an operation announces the global epoch, clear leaves it.
+    RECLAIM_QSBR,   //Quiescent-state-based: protect is a plain load and clear does nothing;
+                    //threads call HazardPointer_quiescent between operations.
+    RECLAIM_ERAS,   //Hazard eras: protect publishes the era clock and re-publishes only when it moved.
+    RECLAIM_NUM_SCHEMES
+} ReclamationScheme;
+
+//Scheme of queues created without one; can be overridden at build time (CMake cache entry QUEUE_RECLAMATION).
+//QSBR cannot be the default: it needs every thread to call HazardPointer_quiescent, which only code written
+//for it does, so it is chosen explicitly with HazardPointer_new / <queue>_new_with_scheme.
+#ifndef RECLAMATION_SCHEME
+#define RECLAMATION_SCHEME RECLAIM_HAZARD
+#endif
+_Static_assert(RECLAMATION_SCHEME != RECLAIM_QSBR, "RECLAIM_QSBR cannot be the default reclamation scheme");
+
+extern const char* ReclamationScheme_names[RECLAIM_NUM_SCHEMES];
+//Returns the scheme with the given name (hazard, epoch, qsbr, eras), or -1 if there is none.
+int ReclamationScheme_find(const char* name);
+
+//Reclamation telemetry of one thread. Written only by the owning thread (relaxed stores),
+//so it can be read at any time by HazardPointer_stats.
+typedef struct RetiredPointer_Stats {
+    _Atomic uint64_t retired;         //Currently retired and not yet freed.
+    _Atomic uint64_t peak_retired;
+    _Atomic uint64_t scans;
+    _Atomic uint64_t fruitless_scans; //Scans that could not free anything.
+    _Atomic uint64_t freed;
+    _Atomic uint64_t scan_cycles;     //Timing_cycles ticks spent scanning.
+    _Atomic uint64_t max_scan_cycles;
+    _Atomic uint64_t scan_threshold;  //Retired list size that triggered the last scan or hand-off.
+} RetiredPointer_Stats;
+
+typedef struct RetiredPointer {
     void* pointer;
-    struct RetiredPointer_Node* next; 
-} RetiredPointer_Node;
+    uint64_t birth;   //Era the object was allocated in, for hazard eras; 0 if unknown.
+    uint64_t retired; //Epoch or era when it was retired.
+} RetiredPointer;
 
+//Retired pointers of one thread in an array that grows to the scan threshold on the first retires
+//and is then reused, so retiring and scanning do not allocate. Each thread's list has its own cache lines.
 typedef struct RetiredPointer_List {
-    RetiredPointer_Node* head;
-    RetiredPointer_Node* tail;
-    int size; 
+    _Alignas(64) RetiredPointer* pointers;
+    int size;
+    int capacity;
+    int scan_at; //Size that triggers the next scan if larger than the threshold, after scans that freed little.
+    uint64_t* scratch; //Snapshot of hazards or eras taken by scans.
+    int scratch_capacity;
+    //With a background reclaimer the thread works on two arrays: a full one is published in batch, and the
+    //reclaimer gives it back empty in returned, so handing garbage over allocates nothing after the first time.
+    RetiredPointer* spare; //The empty second array, NULL while it is with the reclaimer (or before the first hand-off).
+    int spare_capacity;    //Capacity of the second array, 0 before the first hand-off.
+    int batch_size;        //Entries of batch, written before it is published.
+    RetiredPointer_Stats stats;
+    _Alignas(64) _Atomic(RetiredPointer*) batch; //Full array waiting for the reclaimer, NULL if none.
+    _Atomic(RetiredPointer*) returned;           //The same array once the reclaimer took its entries.
 } RetiredPointer_List;
 
+//Retired pointers left behind by a thread that released its id, waiting to be adopted by the next scan.
+typedef struct RetiredPointer_Orphans {
+    struct RetiredPointer_Orphans* next;
+    RetiredPointer* pointers;
+    int size;
+} RetiredPointer_Orphans;
+
+//State of one thread in one HazardPointer.
+typedef struct HazardPointer_Record {
+    _Alignas(64) _Atomic(void*) pointer[HAZARD_SLOTS];
+    //Hazard eras: era published in each slot. Epoch: [0] is the epoch announced by the thread. 0 means none.
+    _Atomic uint64_t era[HAZARD_SLOTS];
+    RetiredPointer_List retired;
+} HazardPointer_Record;
+
+//Configuration read by every retire, the orphan list written by hand-overs, the clock and the chunk
+//directory each start a cache line. A thread's record starts a line with its hazards, its retired list
+//(written only by the owner) starts the next one.
 struct HazardPointer {
-    _Atomic(void*) pointer[MAX_THREADS];
-    RetiredPointer_List* retired_ptrs[MAX_THREADS];
+    ReclamationScheme scheme;
+    size_t node_size;      //Bytes held by one retired pointer, for memory accounting only.
+    int retired_threshold; //Retired list size that triggers a scan (at least 2 * hazards), RETIRED_THRESHOLD by default.
+    _Atomic(struct HazardPointer_Reclaimer*) reclaimer; //Background reclaimer, NULL unless started.
+    struct HazardPointer* prev_domain; //All initialized HazardPointers are linked, to hand orphans over.
+    struct HazardPointer* next_domain;
+    _Alignas(64) _Atomic(RetiredPointer_Orphans*) orphans;
+    _Atomic uint64_t orphaned; //Retired pointers in orphans or in batches handed to the reclaimer.
+    _Alignas(64) _Atomic uint64_t clock; //Global epoch (epoch) or era clock (eras), starting at 1.
+    _Alignas(64) _Atomic(HazardPointer_Record*) chunks[HAZARD_DIRECTORY_BLOCK]; //Chunks of the first ids.
+    _Atomic(_Atomic(HazardPointer_Record*)*) blocks[HAZARD_DIRECTORY_BLOCKS];   //Block b holds chunks from b * BLOCK; [0] is chunks.
 };
 
 typedef struct HazardPointer HazardPointer;
 
+//A thread's state in one HazardPointer, cached so that the *_with calls skip looking up the calling
+//thread's id and record. Valid for the thread that created it until it releases its id.
+typedef struct HazardPointer_Handle {
+    HazardPointer* hp;
+    HazardPointer_Record* record;
+} HazardPointer_Handle;
+
+typedef struct HazardPointer_ThreadStats {
+    uint64_t retired;
+    uint64_t peak_retired;
+    uint64_t scans;
+    uint64_t fruitless_scans;
+    uint64_t freed;
+    uint64_t scan_cycles;
+    uint64_t max_scan_cycles;
+    uint64_t scan_threshold;
+} HazardPointer_ThreadStats;
+
+typedef struct HazardPointer_Stats {
+    HazardPointer_ThreadStats threads[MAX_THREADS]; //Threads with ids below MAX_THREADS, see truncated.
+    int num_threads;                 //1 + the largest id that retired anything.
+    bool truncated;                  //num_threads > MAX_THREADS: threads covers only the first MAX_THREADS ids.
+    HazardPointer_ThreadStats total; //Sums over all threads, orphans and the background reclaimer, except
+                                     //max_scan_cycles, peak_retired and scan_threshold (maxima).
+    size_t bytes_pinned;             //total.retired * node_size.
+    size_t peak_bytes_pinned;        //Sum of per-thread peaks * node_size, an upper bound.
+    double freed_per_scan;
+} HazardPointer_Stats;
+
+//Uses thread_id (0 <= thread_id < num_threads <= HAZARD_MAX_THREADS) as the calling thread's id, and reserves
+//the ids below num_threads for explicit registration, until the thread registers again or exits.
+//The caller keeps ids unique among threads that use queues at the same time: several threads may register
+//the same id one after another (e.g. a main thread and the worker it hands the id to), and registering again
+//leaves the id's state to them. Aborts if the id is held by a thread that acquired it.
 void HazardPointer_register(int thread_id, int num_threads);
+//Takes the lowest free id above all explicit reservations for the calling thread. Threads that use a
+//HazardPointer without registering call it implicitly on first use.
+int HazardPointer_acquire(void);
+//Gives the calling thread's id (and reservation) back, handing its retired pointers to the threads still
+//running. Runs automatically when a thread with an id exits; it must not be inside a queue operation.
+void HazardPointer_release(void);
 void HazardPointer_initialize(HazardPointer* hp);
 void HazardPointer_finalize(HazardPointer* hp);
+//Allocates a HazardPointer with the given scheme that any number of queues can share (<queue>_new_shared):
+//they then use one set of hazard slots and one retired list per thread, and each scan covers the nodes
+//retired by all of them. Set its node size for the telemetry with HazardPointer_set_node_size.
+HazardPointer* HazardPointer_new(ReclamationScheme scheme);
+//Finalizes and frees a HazardPointer from HazardPointer_new, once every queue sharing it is deleted.
+void HazardPointer_delete(HazardPointer* hp);
+//Protects the pointer read from atom in slot 0 of this thread.
 void* HazardPointer_protect(HazardPointer* hp, const _Atomic(void*)* atom);
+//Protects the pointer read from atom in the given slot (0 <= slot < HAZARD_SLOTS), keeping the other slots.
+void* HazardPointer_protect_slot(HazardPointer* hp, int slot, const _Atomic(void*)* atom);
+//Clears slot 0 of this thread.
 void HazardPointer_clear(HazardPointer* hp);
+void HazardPointer_clear_slot(HazardPointer* hp, int slot);
+void HazardPointer_clear_all(HazardPointer* hp);
 void HazardPointer_retire(HazardPointer* hp, void* ptr);
+//Binds handle to hp and the calling thread.
+void HazardPointer_handle(HazardPointer* hp, HazardPointer_Handle* handle);
+void* HazardPointer_protect_with(HazardPointer_Handle* handle, int slot, const _Atomic(void*)* atom);
+void HazardPointer_clear_with(HazardPointer_Handle* handle, int slot);
+void HazardPointer_clear_all_with(HazardPointer_Handle* handle);
+void HazardPointer_retire_with(HazardPointer_Handle* handle, void* ptr, uint64_t birth_era);
+//Selects the reclamation scheme; must be called right after HazardPointer_initialize, before any other use.
+void HazardPointer_set_scheme(HazardPointer* hp, ReclamationScheme scheme);
+//Era to store in a newly allocated object and pass to HazardPointer_retire_born; any scheme.
+uint64_t HazardPointer_era(HazardPointer* hp);
+//Retires ptr allocated in birth_era (from HazardPointer_era). With hazard eras this lets readers of
+//later eras not hold it back; HazardPointer_retire assumes the oldest possible birth.
+void HazardPointer_retire_born(HazardPointer* hp, void* ptr, uint64_t birth_era);
+//QSBR: this thread holds no references into any queue. Call between operations; until a thread
+//first calls it (or after HazardPointer_offline) it is treated as online and blocks reclamation.
+void HazardPointer_quiescent(void);
+//QSBR: this thread stops using queues until its next HazardPointer_quiescent and never blocks reclamation.
+void HazardPointer_offline(void);
+//True if protect publishes with a plain store and scans fence all threads with membarrier instead
+//(needs a build with -DQUEUE_MEMBARRIER=ON and kernel support, otherwise every protect is fenced).
+bool HazardPointer_asymmetric_fences(void);
+//Starts a thread that does every scan and free of hp from then on. A retire that fills the calling thread's
+//retired array (HazardPointer_set_retired_threshold) hands the array over with one CAS instead of scanning,
+//and the reclaimer scans all handed-over pointers every interval_us microseconds. Backpressure: once more
+//than high_watermark retired pointers (0 for no limit) wait for it, the retiring thread wakes the reclaimer
+//and waits for its next scan. Call before threads use hp; ignored if a reclaimer already runs.
+void HazardPointer_start_reclaimer(HazardPointer* hp, long interval_us, size_t high_watermark);
+//Stops the reclaimer, leaving what it could not free yet to the threads' scans. Call when no thread uses hp;
+//HazardPointer_finalize calls it.
+void HazardPointer_stop_reclaimer(HazardPointer* hp);
+//Changes the scan trigger of this HazardPointer. Scans still wait for at least twice as many
+//retired pointers as there are hazard slots of active threads, so that each one frees half the list.
+void HazardPointer_set_retired_threshold(HazardPointer* hp, int threshold);
+//Sets the size of retired objects used by HazardPointer_stats to compute pinned bytes.
+void HazardPointer_set_node_size(HazardPointer* hp, size_t node_size);
+//Snapshot of reclamation telemetry; may be called concurrently with other operations.
+void HazardPointer_stats(HazardPointer* hp, HazardPointer_Stats* stats);
+//Bytes of retired-but-unfreed objects and of heap bookkeeping (retired arrays), excluding *hp itself.
+void HazardPointer_memory_usage(HazardPointer* hp, size_t* retired_bytes, size_t* overhead_bytes);
 
 
 
@@ -0,0 +1,42 @@
+#include <string.h>
+
+#include "Histogram.h"
+
+void Histogram_init(Histogram* h) {
+    memset(h, 0, sizeof(Histogram));
+    h->min = UINT64_MAX;
+}
+
+void Histogram_merge(Histogram* dst, const Histogram* src) {
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) dst->buckets[i] += src->buckets[i];
+    dst->count += src->count;
+    if (src->min < dst->min) dst->min = src->min;
+    if (src->max > dst->max) dst->max = src->max;
+}
+
+//Largest value that maps to the given bucket.
+static uint64_t bucket_upper_bound(int idx) {
+    if (idx < (1 << HISTOGRAM_SUB_BITS)) return (uint64_t)idx;
+    int shift = (idx >> (HISTOGRAM_SUB_BITS - 1)) - 1;
+    uint64_t mantissa = (uint64_t)(idx - (shift << (HISTOGRAM_SUB_BITS - 1)));
+    return ((mantissa + 1) << shift) - 1;
+}
+
+uint64_t Histogram_percentile(const Histogram* h, double q) {
+    if (h->count == 0) return 0;
+    uint64_t rank = (uint64_t)(q * h->count + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank >= h->count) return h->max;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            uint64_t value = bucket_upper_bound(i);
+            if (value > h->max) value = h->max;
+            if (value < h->min) value = h->min;
+            return value;
+        }
+    }
+    return h->max;
+}
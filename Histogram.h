@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+
+//Log-linear (HDR-style) histogram: values below 2^HISTOGRAM_SUB_BITS are counted exactly,
+//larger ones land in one of 2^(HISTOGRAM_SUB_BITS-1) linear sub-buckets per power of two,
+//which keeps the relative error under 2^-(HISTOGRAM_SUB_BITS-1) for any 64-bit value.
+#define HISTOGRAM_SUB_BITS 6
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 2) << (HISTOGRAM_SUB_BITS - 1))
+
+typedef struct Histogram {
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+} Histogram;
+
+static inline int Histogram_bucket(uint64_t value) {
+    if (value < (1ull << HISTOGRAM_SUB_BITS)) return (int)value;
+    int shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BITS + 1;
+    return (shift << (HISTOGRAM_SUB_BITS - 1)) + (int)(value >> shift);
+}
+
+//Hot path: a clz, a shift and three updates of thread-private memory.
+static inline void Histogram_record(Histogram* h, uint64_t value) {
+    h->buckets[Histogram_bucket(value)]++;
+    h->count++;
+    if (value < h->min) h->min = value;
+    if (value > h->max) h->max = value;
+}
+
+void Histogram_init(Histogram* h);
+void Histogram_merge(Histogram* dst, const Histogram* src);
+//Smallest recorded value v such that at least a fraction q of values are <= v (up to bucket precision).
+uint64_t Histogram_percentile(const Histogram* h, double q);
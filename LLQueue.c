@@ -3,145 +3,319 @@
 #include <malloc.h>
 #include <stdatomic.h>
 #include <stdbool.h>
+#include <stdlib.h>
 #include <assert.h>
 #include "HazardPointer.h"
 #include "LLQueue.h"
+#include "QueueBackoff.h"
+#include "QueueDelay.h"
+#include "QueueOrder.h"
+#include "QueueProfile.h"
+#include "QueueTrace.h"
 
 struct LLNode;
 typedef struct LLNode LLNode;
 typedef _Atomic(LLNode*) AtomicLLNodePtr;
 
+//Memory orders: a node is initialized before it is published by the release CAS on tail and the release
+//store of its predecessor's next. Consumers reach it by an acquire load of next and pass it on through
+//release CASes on head, which protect reads with acquire. So both an item and anything its producer wrote
+//before pushing it happen before the pop that takes it, while the item exchange itself can be relaxed.
 struct LLNode {
     AtomicLLNodePtr next;
     _Atomic Value item; 
+    uint64_t birth; //HazardPointer_era when allocated.
 };
 
-LLNode* LLNode_new(Value item) {
+LLNode* LLNode_new(Value item, uint64_t birth) {
     LLNode* node = (LLNode*)malloc(sizeof(LLNode));
     assert(node);
+    node->birth = birth;
     atomic_init(&node->item, item);
     atomic_init(&node->next, NULL);
     return node;
 }
 
+//Read-only fields, head (consumers) and tail (producers) on separate cache lines, as is the backoff
+//rate, which contended operations write.
+//Nodes are not padded: that would triple their size, and each is written by one push and one pop.
 struct LLQueue {
-    AtomicLLNodePtr head;
-    AtomicLLNodePtr tail;
-    HazardPointer hp;
+    HazardPointer* hp;
+    bool owns_hp; //False if the HazardPointer is shared with other queues.
+    QueueBackoffPolicy backoff;
+    _Alignas(64) AtomicLLNodePtr head;
+    _Alignas(64) AtomicLLNodePtr tail;
+    _Alignas(64) _Atomic uint32_t backoff_rate; //Failures per operation, for QUEUE_BACKOFF_ADAPTIVE.
+    QUEUE_STATS_DECLARE
 };
 
+//Waits before retrying a failed attempt, as the queue's QueueBackoffPolicy says.
+static inline void LLQueue_back_off(LLQueue* queue, QueueBackoff* backoff) {
+    uint32_t spins = QueueBackoff_fail(backoff);
+    QUEUE_STAT_ADD(queue, backoff_spins, spins);
+    (void)spins;
+}
+
 
 LLQueue* LLQueue_new(void) {
-    LLQueue* queue = (LLQueue*)malloc(sizeof(LLQueue));
+    return LLQueue_new_with_scheme(RECLAMATION_SCHEME);
+}
+
+static LLQueue* LLQueue_new_on(HazardPointer* hp, bool owns_hp) {
+    LLQueue* queue = (LLQueue*)aligned_alloc(_Alignof(LLQueue), sizeof(LLQueue));
     assert(queue);
-    HazardPointer_initialize(&queue->hp);
+    queue->hp = hp;
+    queue->owns_hp = owns_hp;
+    queue->backoff = BACKOFF_POLICY;
+    atomic_init(&queue->backoff_rate, 0);
+    QUEUE_STATS_INIT(queue);
     //Head, tail initializing, dummy node with empty value at the beginning.
-    AtomicLLNodePtr node = LLNode_new(EMPTY_VALUE);
+    AtomicLLNodePtr node = LLNode_new(EMPTY_VALUE, HazardPointer_era(queue->hp));
     atomic_init(&(queue->head), node);
     atomic_init(&(queue->tail), node);
 
     return queue;
 }
 
+LLQueue* LLQueue_new_with_scheme(int scheme) {
+    HazardPointer* hp = HazardPointer_new(scheme);
+    HazardPointer_set_node_size(hp, sizeof(LLNode));
+    return LLQueue_new_on(hp, true);
+}
+
+LLQueue* LLQueue_new_shared(HazardPointer* hp) {
+    if (hp->node_size == 0) HazardPointer_set_node_size(hp, sizeof(LLNode));
+    return LLQueue_new_on(hp, false);
+}
+
 void LLQueue_delete(LLQueue* queue) {
-    LLNode* curr = atomic_load(&(queue->head)), *next = NULL;
+    LLNode* curr = atomic_load_explicit(&(queue->head), QUEUE_RELAXED), *next = NULL; //Single-threaded.
     // if (curr == NULL) printf("LLQueue_delete: head should never be NULL!");
 
     while (curr != NULL) {
-        next = atomic_load(&curr->next);
+        next = atomic_load_explicit(&curr->next, QUEUE_RELAXED);
         free(curr);
         curr = next;
     }
 
-    HazardPointer_finalize(&queue->hp);
+    if (queue->owns_hp) HazardPointer_delete(queue->hp);
     free(queue);
 }
 
 void LLQueue_push(LLQueue* queue, Value item) {
-    LLNode* new_node = LLNode_new(item);
+    HazardPointer_Handle handle;
+    HazardPointer_handle(queue->hp, &handle);
+    LLQueue_push_with(queue, &handle, item);
+}
+
+void LLQueue_push_with(LLQueue* queue, HazardPointer_Handle* handle, Value item) {
+    QUEUE_TRACE_BEGIN("LLQueue_push");
+    QUEUE_PROFILE_BEGIN();
+    LLNode* new_node = LLNode_new(item, HazardPointer_era(queue->hp));
+    QUEUE_PROFILE_LAP(QUEUE_PROFILE_LL_PUSH, QUEUE_PROFILE_ALLOC);
+    QUEUE_STAT_ADD(queue, operations, 1);
+    QUEUE_STAT_ADD(queue, node_allocs, 1);
+    QUEUE_TRACE_EVENT("node_alloc", new_node);
+    QueueBackoff backoff;
+    QueueBackoff_begin(&backoff, queue->backoff, &queue->backoff_rate);
     bool finished = false;
     while (!finished) {
+        QUEUE_STAT_ADD(queue, iterations, 1);
 
         //Our expected tail will be protected.
-        LLNode* expected_tail = HazardPointer_protect(&(queue->hp), (const _Atomic(void*)*)&(queue->tail));
+        LLNode* expected_tail = HazardPointer_protect_with(handle, 0, (const _Atomic(void*)*)&(queue->tail));
         //if (expected_tail == NULL) printf("LLQueue_push: tail should never be NULL!");
+        QUEUE_PROFILE_LAP(QUEUE_PROFILE_LL_PUSH, QUEUE_PROFILE_PROTECT);
 
-        //If current tail = expected_tail, queue->tail will be changed to new_node
-        if (atomic_compare_exchange_strong (&(queue->tail), &expected_tail, new_node)) {
-            // if (atomic_load(&(expected_tail->next)) != NULL) printf("LLQueue_push: expected_tail->next should be NULL!\n");
-            atomic_store(&(expected_tail->next), new_node);
+        //If current tail = expected_tail, queue->tail will be changed to new_node.
+        //Release publishes new_node to the next producer; a failure only leads to another protect.
+        if (atomic_compare_exchange_strong_explicit(&(queue->tail), &expected_tail, new_node, QUEUE_RELEASE, QUEUE_RELAXED)) {
+            QUEUE_DELAY_POINT(QUEUE_DELAY_LL_PUSH_LINK);
+            //Release publishes new_node and its item to consumers.
+            atomic_store_explicit(&(expected_tail->next), new_node, QUEUE_RELEASE);
+            QUEUE_STAT_ADD(queue, tail_advances, 1);
+            QUEUE_TRACE_EVENT("tail_advance", new_node);
             finished = true;
         }
 
         //Else: tail has changed, start again. 
+        else {
+            QUEUE_STAT_ADD(queue, cas_failures, 1);
+            QUEUE_TRACE_EVENT("cas_fail", expected_tail);
+        }
+        QUEUE_PROFILE_LAP(QUEUE_PROFILE_LL_PUSH, QUEUE_PROFILE_CAS);
+        if (!finished) {
+            LLQueue_back_off(queue, &backoff);
+            QUEUE_PROFILE_LAP(QUEUE_PROFILE_LL_PUSH, QUEUE_PROFILE_BACKOFF);
+        }
     }
     
-    HazardPointer_clear(&queue->hp);
+    QueueBackoff_end(&backoff);
+    HazardPointer_clear_with(handle, 0);
+    QUEUE_PROFILE_LAP(QUEUE_PROFILE_LL_PUSH, QUEUE_PROFILE_CLEAR);
+    QUEUE_PROFILE_END(QUEUE_PROFILE_LL_PUSH);
+    QUEUE_TRACE_END("LLQueue_push");
 }
 
 Value LLQueue_pop(LLQueue* queue) {
+    HazardPointer_Handle handle;
+    HazardPointer_handle(queue->hp, &handle);
+    return LLQueue_pop_with(queue, &handle);
+}
+
+Value LLQueue_pop_with(LLQueue* queue, HazardPointer_Handle* handle) {
     Value value = EMPTY_VALUE; //Here we will store head's item.
+    QUEUE_TRACE_BEGIN("LLQueue_pop");
+    QUEUE_PROFILE_BEGIN();
+    QUEUE_STAT_ADD(queue, operations, 1);
+    QueueBackoff backoff;
+    QueueBackoff_begin(&backoff, queue->backoff, &queue->backoff_rate);
     bool finished = false;
     while (!finished) {
+        QUEUE_STAT_ADD(queue, iterations, 1);
         value = EMPTY_VALUE;  
 
         //Our expected head will be protected.
-        LLNode* expected_head = HazardPointer_protect(&queue->hp, (const _Atomic(void*)*)&(queue->head));
+        LLNode* expected_head = HazardPointer_protect_with(handle, 0, (const _Atomic(void*)*)&(queue->head));
         //if (expected_head == NULL) printf("LLQueue_pop: head should never be NULL!");
-        //Head has changed. Start again.
-        if (expected_head != atomic_load(&(queue->head))) continue;
+        //Head has changed. Start again. Only a shortcut, protect already validated the pointer.
+        bool moved = expected_head != atomic_load_explicit(&(queue->head), QUEUE_RELAXED);
+        QUEUE_PROFILE_LAP(QUEUE_PROFILE_LL_POP, QUEUE_PROFILE_PROTECT);
+        if (moved) {
+            LLQueue_back_off(queue, &backoff);
+            QUEUE_PROFILE_LAP(QUEUE_PROFILE_LL_POP, QUEUE_PROFILE_BACKOFF);
+            continue;
+        }
 
-        value = atomic_exchange(&(expected_head->item), EMPTY_VALUE); //seg? 
+        //Relaxed: the acquire in protect already ordered the item's push before this, see LLNode.
+        value = atomic_exchange_explicit(&(expected_head->item), EMPTY_VALUE, QUEUE_RELAXED);
+        QUEUE_PROFILE_LAP(QUEUE_PROFILE_LL_POP, QUEUE_PROFILE_EXCHANGE);
 
         //We read actual pushed value.
         if (value != EMPTY_VALUE) {
             finished = true;
         }
 
-        //Trying to move the head if has next.
-        if (atomic_load(&(expected_head->next)) != NULL) {
-            if (atomic_compare_exchange_strong(&(queue->head), &expected_head, atomic_load(&(expected_head->next)))) {
-                HazardPointer_retire(&(queue->hp), expected_head);
-            };
+        //Trying to move the head if has next. Acquire, as the next node is passed on through head.
+        LLNode* next = atomic_load_explicit(&(expected_head->next), QUEUE_ACQUIRE);
+        if (next != NULL) {
+            if (!finished) QUEUE_STAT_ADD(queue, empty_slot_retries, 1);
+            if (atomic_compare_exchange_strong_explicit(&(queue->head), &expected_head, next, QUEUE_RELEASE, QUEUE_RELAXED)) {
+                QUEUE_STAT_ADD(queue, head_advances, 1);
+                QUEUE_TRACE_EVENT("head_advance", expected_head);
+                QUEUE_PROFILE_LAP(QUEUE_PROFILE_LL_POP, QUEUE_PROFILE_CAS);
+                HazardPointer_retire_with(handle, expected_head, expected_head->birth);
+                QUEUE_PROFILE_LAP(QUEUE_PROFILE_LL_POP, QUEUE_PROFILE_RETIRE);
+            }
+            else {
+                QUEUE_STAT_ADD(queue, cas_failures, 1);
+                QUEUE_TRACE_EVENT("cas_fail", expected_head);
+                QUEUE_PROFILE_LAP(QUEUE_PROFILE_LL_POP, QUEUE_PROFILE_CAS);
+                if (!finished) {
+                    LLQueue_back_off(queue, &backoff);
+                    QUEUE_PROFILE_LAP(QUEUE_PROFILE_LL_POP, QUEUE_PROFILE_BACKOFF);
+                }
+            }
         }
         
         //Head next is NULL. Finishing with return value (modified or not). 
         else finished = true;
     }
 
-    HazardPointer_clear(&(queue->hp));
+    QueueBackoff_end(&backoff);
+    HazardPointer_clear_with(handle, 0);
+    QUEUE_PROFILE_LAP(QUEUE_PROFILE_LL_POP, QUEUE_PROFILE_CLEAR);
+    QUEUE_PROFILE_END(QUEUE_PROFILE_LL_POP);
+    QUEUE_TRACE_END("LLQueue_pop");
     return value;
 }
 
 bool LLQueue_is_empty(LLQueue* queue) {
+    HazardPointer_Handle handle;
+    HazardPointer_handle(queue->hp, &handle);
+    return LLQueue_is_empty_with(queue, &handle);
+}
+
+bool LLQueue_is_empty_with(LLQueue* queue, HazardPointer_Handle* handle) {
     Value value = EMPTY_VALUE; //Here we will store head's item.
+    QUEUE_TRACE_BEGIN("LLQueue_is_empty");
+    QUEUE_STAT_ADD(queue, operations, 1);
+    QueueBackoff backoff;
+    QueueBackoff_begin(&backoff, queue->backoff, &queue->backoff_rate);
 
     bool finished = false;
     while (!finished) {
+        QUEUE_STAT_ADD(queue, iterations, 1);
         value = EMPTY_VALUE;  
-        LLNode* expected_head = HazardPointer_protect(&(queue->hp), (const _Atomic(void*)*)&queue->head);
+        LLNode* expected_head = HazardPointer_protect_with(handle, 0, (const _Atomic(void*)*)&queue->head);
         // if (expected_head == NULL) printf("LLQueue_empty: head should never be NULL!");
 
-        if (expected_head != atomic_load(&(queue->head))) continue;
+        if (expected_head != atomic_load_explicit(&(queue->head), QUEUE_RELAXED)) {
+            LLQueue_back_off(queue, &backoff);
+            continue;
+        }
 
-        //Value was not empty value: queue not empty. Finishing.
-        if ((value = atomic_load(&expected_head->item)) != EMPTY_VALUE) {
+        //Value was not empty value: queue not empty. Finishing. Only the answer is used, so relaxed.
+        if ((value = atomic_load_explicit(&expected_head->item, QUEUE_RELAXED)) != EMPTY_VALUE) {
             finished = true;
         }
 
         //Value was empty value - checking whether we can move head.
         else {
-            if (atomic_load(&(expected_head->next)) != NULL) {
-                if (atomic_compare_exchange_strong(&(queue->head), &expected_head, atomic_load(&(expected_head->next)))) {
-                        HazardPointer_retire(&(queue->hp), expected_head);
-                };
+            LLNode* next = atomic_load_explicit(&(expected_head->next), QUEUE_ACQUIRE);
+            if (next != NULL) {
+                QUEUE_STAT_ADD(queue, empty_slot_retries, 1);
+                if (atomic_compare_exchange_strong_explicit(&(queue->head), &expected_head, next, QUEUE_RELEASE, QUEUE_RELAXED)) {
+                        QUEUE_STAT_ADD(queue, head_advances, 1);
+                        QUEUE_TRACE_EVENT("head_advance", expected_head);
+                        HazardPointer_retire_with(handle, expected_head, expected_head->birth);
+                }
+                else {
+                    QUEUE_STAT_ADD(queue, cas_failures, 1);
+                    QUEUE_TRACE_EVENT("cas_fail", expected_head);
+                    LLQueue_back_off(queue, &backoff);
+                }
             }
             //Head next is NULL. Finishing with return value == EMPTY_VALUE. 
             else finished = true;
         }
         
     }
-    HazardPointer_clear(&(queue->hp));
+    QueueBackoff_end(&backoff);
+    HazardPointer_clear_with(handle, 0);
+    QUEUE_TRACE_END("LLQueue_is_empty");
 
     return value == EMPTY_VALUE;
 }
+
+void LLQueue_handle(LLQueue* queue, HazardPointer_Handle* handle) {
+    HazardPointer_handle(queue->hp, handle);
+}
+
+void LLQueue_set_backoff(LLQueue* queue, int policy) {
+    queue->backoff = policy;
+}
+
+void LLQueue_stats(LLQueue* queue, QueueStats* stats) {
+    QUEUE_STATS_COLLECT(queue, stats);
+}
+
+void LLQueue_hazard_stats(LLQueue* queue, HazardPointer_Stats* stats) {
+    HazardPointer_stats(queue->hp, stats);
+}
+
+void LLQueue_memory_usage(LLQueue* queue, QueueMemoryUsage* usage) {
+    size_t nodes = 0;
+    for (LLNode* node = atomic_load_explicit(&queue->head, QUEUE_ACQUIRE); node != NULL;
+         node = atomic_load_explicit(&node->next, QUEUE_ACQUIRE)) nodes++;
+
+    usage->node_bytes = nodes * sizeof(LLNode);
+    if (queue->owns_hp) {
+        HazardPointer_memory_usage(queue->hp, &usage->retired_bytes, &usage->overhead_bytes);
+        usage->overhead_bytes += sizeof(HazardPointer);
+    } else {
+        usage->retired_bytes = 0; //Accounted once for all queues by HazardPointer_memory_usage.
+        usage->overhead_bytes = 0;
+    }
+    usage->overhead_bytes += sizeof(LLQueue);
+}
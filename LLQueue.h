@@ -2,13 +2,36 @@
 
 #include <stdbool.h>
 
+#include "QueueStats.h"
 #include "common.h"
 
 struct LLQueue;
 typedef struct LLQueue LLQueue;
+struct HazardPointer;
+struct HazardPointer_Stats;
+struct HazardPointer_Handle;
 
 LLQueue* LLQueue_new(void);
+//Creates a queue reclaiming its nodes with the given ReclamationScheme (see HazardPointer.h).
+LLQueue* LLQueue_new_with_scheme(int scheme);
+//Creates a queue reclaiming its nodes through hp (from HazardPointer_new), which other queues may share.
+//Deleting the queue leaves hp to the caller; its retired nodes are freed by later scans of hp.
+//Sets hp's node size (for the telemetry) if it has none yet.
+LLQueue* LLQueue_new_shared(struct HazardPointer* hp);
 void LLQueue_delete(LLQueue* queue);
 void LLQueue_push(LLQueue* queue, Value item);
 Value LLQueue_pop(LLQueue* queue);
 bool LLQueue_is_empty(LLQueue* queue);
+//Binds handle to the queue and the calling thread, for the *_with operations below.
+void LLQueue_handle(LLQueue* queue, struct HazardPointer_Handle* handle);
+//The operations above, with the calling thread's handle for this queue from LLQueue_handle.
+void LLQueue_push_with(LLQueue* queue, struct HazardPointer_Handle* handle, Value item);
+Value LLQueue_pop_with(LLQueue* queue, struct HazardPointer_Handle* handle);
+bool LLQueue_is_empty_with(LLQueue* queue, struct HazardPointer_Handle* handle);
+//Sets the QueueBackoffPolicy (see QueueBackoff.h) of the queue's retry loops, before threads use the queue.
+void LLQueue_set_backoff(LLQueue* queue, int policy);
+//Sums the contention counters of all threads; all zero unless built with QUEUE_STATS.
+void LLQueue_stats(LLQueue* queue, QueueStats* stats);
+void LLQueue_memory_usage(LLQueue* queue, QueueMemoryUsage* usage);
+//Reclamation telemetry of the queue's HazardPointer.
+void LLQueue_hazard_stats(LLQueue* queue, struct HazardPointer_Stats* stats);
@@ -0,0 +1,111 @@
+#define _GNU_SOURCE
+
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "PerfCounters.h"
+
+const char* PerfCounters_names[PERF_NUM_EVENTS] = {
+    "cycles", "instructions", "l1d_misses", "llc_misses", "hitm", "branch_misses"
+};
+
+#define CACHE_EVENT(cache, op, result) \
+    ((cache) | ((op) << 8) | ((result) << 16))
+
+//MEM_LOAD_L3_HIT_RETIRED.XSNP_HITM (event 0xd2, umask 0x04) on Skylake and later Intel cores.
+#define INTEL_XSNP_HITM 0x04d2
+
+static bool is_intel(void) {
+    FILE* f = fopen("/proc/cpuinfo", "r");
+    if (!f) return false;
+    char line[256];
+    bool intel = false;
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, "vendor_id", 9) == 0) {
+            intel = strstr(line, "GenuineIntel") != NULL;
+            break;
+        }
+    }
+    fclose(f);
+    return intel;
+}
+
+static int open_event(uint32_t type, uint64_t config, int group_fd) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = group_fd < 0;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID
+                     | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+bool PerfCounters_open(PerfCounters* pc) {
+    static const struct { uint32_t type; uint64_t config; } events[PERF_NUM_EVENTS] = {
+        [PERF_CYCLES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+        [PERF_INSTRUCTIONS] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+        [PERF_L1D_MISSES] = { PERF_TYPE_HW_CACHE, CACHE_EVENT(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ,
+                                                              PERF_COUNT_HW_CACHE_RESULT_MISS) },
+        [PERF_LLC_MISSES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+        [PERF_HITM] = { PERF_TYPE_RAW, INTEL_XSNP_HITM },
+        [PERF_BRANCH_MISSES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    };
+
+    memset(pc, 0, sizeof(PerfCounters));
+    for (int i = 0; i < PERF_NUM_EVENTS; i++) pc->fds[i] = -1;
+
+    pc->fds[PERF_CYCLES] = open_event(events[PERF_CYCLES].type, events[PERF_CYCLES].config, -1);
+    if (pc->fds[PERF_CYCLES] < 0) return false;
+
+    bool intel = is_intel();
+    for (int i = PERF_CYCLES + 1; i < PERF_NUM_EVENTS; i++) {
+        if (i == PERF_HITM && !intel) continue;
+        pc->fds[i] = open_event(events[i].type, events[i].config, pc->fds[PERF_CYCLES]);
+    }
+    return true;
+}
+
+void PerfCounters_start(PerfCounters* pc) {
+    if (pc->fds[PERF_CYCLES] < 0) return;
+    ioctl(pc->fds[PERF_CYCLES], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(pc->fds[PERF_CYCLES], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void PerfCounters_stop(PerfCounters* pc) {
+    int leader = pc->fds[PERF_CYCLES];
+    if (leader < 0) return;
+    ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+    //Layout for PERF_FORMAT_GROUP | ID | TOTAL_TIME_*: nr, time_enabled, time_running, {value, id}[nr].
+    uint64_t buf[3 + 2 * PERF_NUM_EVENTS];
+    if (read(leader, buf, sizeof(buf)) < (ssize_t)(3 * sizeof(uint64_t))) return;
+    uint64_t nr = buf[0], enabled = buf[1], running = buf[2];
+    double scale = running > 0 ? (double)enabled / running : 0.0;
+
+    uint64_t ids[PERF_NUM_EVENTS];
+    for (int i = 0; i < PERF_NUM_EVENTS; i++) {
+        ids[i] = UINT64_MAX;
+        if (pc->fds[i] >= 0) ioctl(pc->fds[i], PERF_EVENT_IOC_ID, &ids[i]);
+    }
+    for (uint64_t k = 0; k < nr && k < PERF_NUM_EVENTS; k++) {
+        uint64_t value = buf[3 + 2 * k], id = buf[4 + 2 * k];
+        for (int i = 0; i < PERF_NUM_EVENTS; i++) {
+            if (ids[i] == id) pc->values[i] = (uint64_t)(value * scale);
+        }
+    }
+}
+
+void PerfCounters_close(PerfCounters* pc) {
+    for (int i = PERF_NUM_EVENTS - 1; i >= 0; i--) {
+        if (pc->fds[i] >= 0) close(pc->fds[i]);
+        pc->fds[i] = -1;
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//Per-thread hardware counters read through perf_event_open(2). Events the CPU, kernel or
+//perf_event_paranoid setting does not allow are skipped; if even the cycle counter cannot be
+//opened, PerfCounters_open returns false and the caller carries on without counters.
+
+typedef enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,
+    PERF_LLC_MISSES,
+    PERF_HITM,         //Loads served by a modified line in another core's cache (Intel only).
+    PERF_BRANCH_MISSES,
+    PERF_NUM_EVENTS
+} PerfEvent;
+
+extern const char* PerfCounters_names[PERF_NUM_EVENTS];
+
+typedef struct PerfCounters {
+    int fds[PERF_NUM_EVENTS]; //-1 for events that could not be opened.
+    uint64_t values[PERF_NUM_EVENTS];
+} PerfCounters;
+
+//Opens a disabled group counting the calling thread in user space.
+bool PerfCounters_open(PerfCounters* pc);
+void PerfCounters_start(PerfCounters* pc);
+//Stops counting and stores the values, scaled up if the group was multiplexed.
+void PerfCounters_stop(PerfCounters* pc);
+void PerfCounters_close(PerfCounters* pc);
+static inline bool PerfCounters_has(const PerfCounters* pc, PerfEvent event) {
+    return pc->fds[event] >= 0;
+}
@@ -0,0 +1,69 @@
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <threads.h>
+
+#include "QueueBackoff.h"
+#include "Random.h"
+
+const char* QueueBackoff_policy_names[QUEUE_BACKOFF_NUM_POLICIES] = { "none", "exp", "adaptive" };
+
+int QueueBackoff_find(const char* name) {
+    for (int i = 0; i < QUEUE_BACKOFF_NUM_POLICIES; i++) {
+        if (strcmp(name, QueueBackoff_policy_names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+static thread_local uint32_t quiet_ops = 0; //Adaptive: operations without failures since the last update.
+
+//First limit of a contended operation under the adaptive policy, 0 to retry at once.
+static uint32_t adaptive_limit(QueueBackoff* backoff) {
+    uint32_t rate = atomic_load_explicit(backoff->rate, memory_order_relaxed); //An estimate, orders nothing.
+    if (rate < QUEUE_BACKOFF_RATE_ONE / 4) return 0;
+    //An operation with f failures reached a limit of MIN << f; start from there.
+    uint32_t shift = rate / QUEUE_BACKOFF_RATE_ONE;
+    if (shift > 16) shift = 16;
+    uint32_t limit = QUEUE_BACKOFF_MIN_SPINS << shift;
+    return limit < QUEUE_BACKOFF_MAX_SPINS ? limit : QUEUE_BACKOFF_MAX_SPINS;
+}
+
+uint32_t QueueBackoff_fail(QueueBackoff* backoff) {
+    backoff->failures++;
+    if (backoff->policy == QUEUE_BACKOFF_NONE) return 0;
+
+    if (backoff->limit == 0) {
+        backoff->limit = QUEUE_BACKOFF_MIN_SPINS;
+        if (backoff->policy == QUEUE_BACKOFF_ADAPTIVE) {
+            uint32_t limit = adaptive_limit(backoff);
+            if (limit == 0) return 0; //Uncontended lately: retry at once, back off from the next failure.
+            backoff->limit = limit;
+        }
+    }
+
+    //Random within [limit / 2, limit], so that threads that failed together do not retry together.
+    uint32_t spins = backoff->limit / 2 + Random_next() % (backoff->limit / 2 + 1);
+    for (uint32_t i = 0; i < spins; i++) QueueBackoff_pause();
+
+    backoff->limit *= 2;
+    if (backoff->limit > QUEUE_BACKOFF_MAX_SPINS) backoff->limit = QUEUE_BACKOFF_MAX_SPINS;
+    return spins;
+}
+
+//Exponential moving average with weight 1/8. Operations without failures are folded in by sixteen at
+//a time, so an uncontended queue costs a thread-local increment per operation and no shared writes.
+//Concurrent updates may lose one another, which only makes the estimate a little noisier.
+void QueueBackoff_update(QueueBackoff* backoff) {
+    if (backoff->failures == 0 && ++quiet_ops < 16) return;
+    uint32_t rate = atomic_load_explicit(backoff->rate, memory_order_relaxed);
+    uint32_t next = rate;
+    if (backoff->failures == 0) {
+        next = rate >> 3; //(7/8)^16 is about 1/8.
+        quiet_ops = 0;
+    }
+    else {
+        uint32_t sample = backoff->failures * QUEUE_BACKOFF_RATE_ONE;
+        next = rate - rate / 8 + sample / 8;
+    }
+    if (next != rate) atomic_store_explicit(backoff->rate, next, memory_order_relaxed);
+}
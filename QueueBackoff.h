@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+//Contention management for the retry loops of LLQueue and BLQueue. After a failed CAS on head or tail,
+//or finding that head or tail moved since it was protected, the operation spins on pause before retrying,
+//so that threads hammering the same cache line spread out instead of taking it from each other on every attempt.
+//The policy is chosen per queue (<queue>_set_backoff, default from the CMake cache entry QUEUE_BACKOFF):
+//- QUEUE_BACKOFF_NONE retries at once.
+//- QUEUE_BACKOFF_EXPONENTIAL waits a random number of pauses between half the limit and the limit, which
+//  starts at QUEUE_BACKOFF_MIN_SPINS and doubles with every failure of the operation up to QUEUE_BACKOFF_MAX_SPINS.
+//- QUEUE_BACKOFF_ADAPTIVE does the same, but starts the limit from the queue's recent failures per operation:
+//  the first retry is immediate while the queue has been uncontended, and a contended queue starts close to
+//  the limit that recent operations needed.
+
+#ifndef QUEUE_BACKOFF_MIN_SPINS
+#define QUEUE_BACKOFF_MIN_SPINS 4
+#endif
+#ifndef QUEUE_BACKOFF_MAX_SPINS
+#define QUEUE_BACKOFF_MAX_SPINS 1024
+#endif
+
+typedef enum {
+    QUEUE_BACKOFF_NONE,
+    QUEUE_BACKOFF_EXPONENTIAL,
+    QUEUE_BACKOFF_ADAPTIVE,
+    QUEUE_BACKOFF_NUM_POLICIES
+} QueueBackoffPolicy;
+
+//Build default, set with -DQUEUE_BACKOFF=none|exp|adaptive.
+#ifndef BACKOFF_POLICY
+#define BACKOFF_POLICY QUEUE_BACKOFF_NONE
+#endif
+
+//Failure rates are kept in 1/QUEUE_BACKOFF_RATE_ONE failures per operation.
+#define QUEUE_BACKOFF_RATE_ONE 256
+
+extern const char* QueueBackoff_policy_names[QUEUE_BACKOFF_NUM_POLICIES];
+//Returns the policy with the given name ("none", "exp" or "adaptive"), or -1 if there is none.
+int QueueBackoff_find(const char* name);
+
+//State of one operation, on its stack.
+typedef struct QueueBackoff {
+    QueueBackoffPolicy policy;
+    _Atomic uint32_t* rate; //The queue's moving average of failures per operation (adaptive only).
+    uint32_t limit;         //Most pauses of the next wait; 0 before the first failure.
+    uint32_t failures;
+} QueueBackoff;
+
+static inline void QueueBackoff_pause(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    __asm__ volatile("yield");
+#endif
+}
+
+static inline void QueueBackoff_begin(QueueBackoff* backoff, QueueBackoffPolicy policy, _Atomic uint32_t* rate) {
+    backoff->policy = policy;
+    backoff->rate = rate;
+    backoff->limit = 0;
+    backoff->failures = 0;
+}
+
+//Called after a failed attempt, before retrying: waits as the policy says. Returns the number of pauses.
+uint32_t QueueBackoff_fail(QueueBackoff* backoff);
+//Folds the failures of a finished operation into the queue's rate.
+void QueueBackoff_update(QueueBackoff* backoff);
+
+//Called when the operation is done; only the adaptive policy does anything.
+static inline void QueueBackoff_end(QueueBackoff* backoff) {
+    if (backoff->policy == QUEUE_BACKOFF_ADAPTIVE) QueueBackoff_update(backoff);
+}
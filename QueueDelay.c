@@ -0,0 +1,54 @@
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <threads.h>
+#include <time.h>
+
+#include "QueueDelay.h"
+#include "Random.h"
+
+const char* QueueDelay_point_names[QUEUE_DELAY_NUM_POINTS] = {
+    "ll_push_link", "bl_push_slot", "bl_push_link", "bl_pop_slot", "lock_held"
+};
+
+static _Atomic int delay_mode = QUEUE_DELAY_OFF;
+static _Atomic uint32_t delay_threshold = 0; //Delay when a 32-bit random number is below this.
+static _Atomic long delay_ns = 0;
+static _Atomic unsigned long injected[QUEUE_DELAY_NUM_POINTS];
+
+bool QueueDelay_enabled(void) {
+#ifdef QUEUE_DELAY_INJECTION
+    return true;
+#else
+    return false;
+#endif
+}
+
+void QueueDelay_configure(QueueDelayMode mode, double probability, long sleep_ns) {
+    if (probability < 0) probability = 0;
+    if (probability > 1) probability = 1;
+    atomic_store(&delay_threshold, (uint32_t)(probability * UINT32_MAX));
+    atomic_store(&delay_ns, sleep_ns);
+    if (mode != QUEUE_DELAY_OFF) {
+        for (int i = 0; i < QUEUE_DELAY_NUM_POINTS; i++) atomic_store(&injected[i], 0);
+    }
+    atomic_store(&delay_mode, mode);
+}
+
+unsigned long QueueDelay_injected(QueueDelayPoint point) {
+    return atomic_load(&injected[point]);
+}
+
+void QueueDelay_inject(QueueDelayPoint point) {
+    int mode = atomic_load_explicit(&delay_mode, memory_order_relaxed);
+    if (mode == QUEUE_DELAY_OFF) return;
+    if (Random_next() >= atomic_load_explicit(&delay_threshold, memory_order_relaxed)) return;
+
+    atomic_fetch_add_explicit(&injected[point], 1, memory_order_relaxed);
+    if (mode == QUEUE_DELAY_YIELD) sched_yield();
+    else {
+        long ns = atomic_load_explicit(&delay_ns, memory_order_relaxed);
+        struct timespec ts = { ns / 1000000000L, ns % 1000000000L };
+        nanosleep(&ts, NULL);
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdbool.h>
+
+//Delay injection for preemption stress tests, compiled in only with -DQUEUE_DELAY_INJECTION
+//(CMake option QUEUE_DELAY_INJECTION). The queues mark the windows in which a preempted thread
+//hurts others most with QUEUE_DELAY_POINT; when enabled, each point yields or sleeps with the
+//configured probability. Without the flag the points expand to nothing.
+
+typedef enum {
+    QUEUE_DELAY_LL_PUSH_LINK, //LLQueue_push: tail swung to the new node, old tail's next not yet set.
+    QUEUE_DELAY_BL_PUSH_SLOT, //BLQueue_push: slot index taken, value not yet stored.
+    QUEUE_DELAY_BL_PUSH_LINK, //BLQueue_push: tail swung to the new node, old tail's next not yet set.
+    QUEUE_DELAY_BL_POP_SLOT,  //BLQueue_pop: slot index taken, value not yet taken.
+    QUEUE_DELAY_LOCK_HELD,    //SimpleQueue/RingsQueue: inside push or pop critical section.
+    QUEUE_DELAY_NUM_POINTS
+} QueueDelayPoint;
+
+typedef enum { QUEUE_DELAY_OFF, QUEUE_DELAY_YIELD, QUEUE_DELAY_SLEEP } QueueDelayMode;
+
+extern const char* QueueDelay_point_names[QUEUE_DELAY_NUM_POINTS];
+
+//True if the queues were built with delay points.
+bool QueueDelay_enabled(void);
+//Sets what every delay point does from now on; probability is per point hit.
+//Enabling delays resets the injection counters, disabling them keeps the counts for reporting.
+void QueueDelay_configure(QueueDelayMode mode, double probability, long sleep_ns);
+//Number of delays injected at the given point since delays were last enabled.
+unsigned long QueueDelay_injected(QueueDelayPoint point);
+void QueueDelay_inject(QueueDelayPoint point);
+
+#ifdef QUEUE_DELAY_INJECTION
+#define QUEUE_DELAY_POINT(point) QueueDelay_inject(point)
+#else
+#define QUEUE_DELAY_POINT(point) ((void)0)
+#endif
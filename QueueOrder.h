@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdatomic.h>
+
+//Memory orders of the atomics that synchronize the queues and HazardPointer. Each operation uses the
+//weakest order it needs, with the reason next to it. Configuring with -DQUEUE_SEQ_CST=ON makes all of
+//them seq_cst, to measure what the weaker orders save or to rule them out when hunting a bug.
+//Telemetry counters are relaxed in both builds; they order nothing.
+#ifdef QUEUE_SEQ_CST
+#define QUEUE_RELAXED memory_order_seq_cst
+#define QUEUE_ACQUIRE memory_order_seq_cst
+#define QUEUE_RELEASE memory_order_seq_cst
+#define QUEUE_ACQ_REL memory_order_seq_cst
+#else
+#define QUEUE_RELAXED memory_order_relaxed
+#define QUEUE_ACQUIRE memory_order_acquire
+#define QUEUE_RELEASE memory_order_release
+#define QUEUE_ACQ_REL memory_order_acq_rel
+#endif
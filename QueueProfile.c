@@ -0,0 +1,80 @@
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <threads.h>
+
+#include "QueueProfile.h"
+#include "Timing.h"
+
+const char* QueueProfile_site_names[QUEUE_PROFILE_NUM_SITES] = { "LLQueue_push", "LLQueue_pop", "BLQueue_push", "BLQueue_pop" };
+const char* QueueProfile_phase_names[QUEUE_PROFILE_NUM_PHASES] = {
+    "protect", "fetch_add", "exchange", "malloc+init", "cas", "retire", "clear", "backoff"
+};
+
+thread_local QueueProfileThread* QueueProfile_current = NULL;
+static _Atomic(QueueProfileThread*) threads = NULL;
+static atomic_flag print_registered = ATOMIC_FLAG_INIT;
+
+bool QueueProfile_enabled(void) {
+#ifdef QUEUE_PROFILE
+    return true;
+#else
+    return false;
+#endif
+}
+
+static void print_at_exit(void) {
+    QueueProfile_print(stderr);
+}
+
+//Totals outlive their threads so that the table at exit includes threads that have finished.
+QueueProfileThread* QueueProfile_thread(void) {
+    if (QueueProfile_current) return QueueProfile_current;
+    QueueProfileThread* t = calloc(1, sizeof(QueueProfileThread));
+    assert(t);
+
+    QueueProfileThread* head = atomic_load(&threads);
+    do {
+        t->next = head;
+    } while (!atomic_compare_exchange_weak(&threads, &head, t));
+    if (!atomic_flag_test_and_set(&print_registered)) atexit(print_at_exit);
+    return QueueProfile_current = t;
+}
+
+void QueueProfile_print(FILE* out) {
+    QueueProfileThread sum = { 0 };
+    int num_threads = 0;
+    for (QueueProfileThread* t = atomic_load(&threads); t != NULL; t = t->next) {
+        num_threads++;
+        for (int s = 0; s < QUEUE_PROFILE_NUM_SITES; s++) {
+            sum.ops[s] += t->ops[s];
+            for (int p = 0; p < QUEUE_PROFILE_NUM_PHASES; p++) {
+                sum.cycles[s][p] += t->cycles[s][p];
+                sum.laps[s][p] += t->laps[s][p];
+            }
+        }
+    }
+
+    double ticks_per_ns = Timing_cycles_per_ns();
+    bool header = false;
+    for (int s = 0; s < QUEUE_PROFILE_NUM_SITES; s++) {
+        if (sum.ops[s] == 0) continue;
+        if (!header) {
+            fprintf(out, "Phase profile (%d threads, %.2f ticks/ns, %lu ticks timer overhead per lap):\n",
+                    num_threads, ticks_per_ns, (unsigned long)Timing_overhead());
+            header = true;
+        }
+        uint64_t total = 0;
+        for (int p = 0; p < QUEUE_PROFILE_NUM_PHASES; p++) total += sum.cycles[s][p];
+        fprintf(out, "  %-12s ops=%lu  %.1f ticks/op\n", QueueProfile_site_names[s], (unsigned long)sum.ops[s],
+                (double)total / sum.ops[s]);
+        fprintf(out, "    %-12s %8s %12s %12s %7s\n", "phase", "laps/op", "ticks/op", "ticks/lap", "share");
+        for (int p = 0; p < QUEUE_PROFILE_NUM_PHASES; p++) {
+            uint64_t laps = sum.laps[s][p];
+            if (laps == 0) continue;
+            fprintf(out, "    %-12s %8.2f %12.1f %12.1f %6.1f%%\n", QueueProfile_phase_names[p],
+                    (double)laps / sum.ops[s], (double)sum.cycles[s][p] / sum.ops[s],
+                    (double)sum.cycles[s][p] / laps, total > 0 ? 100.0 * sum.cycles[s][p] / total : 0.0);
+        }
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+//Phase-level cycle attribution, compiled in only with -DQUEUE_PROFILE (CMake option QUEUE_PROFILE).
+//LLQueue/BLQueue push and pop take a Timing_cycles timestamp at every phase boundary and charge the
+//cycles since the previous boundary to the phase just finished, in per-thread totals. A breakdown
+//table per operation is printed to stderr at exit. Each boundary costs a serialized rdtsc
+//(see Timing_overhead), which is included in the phase it ends.
+//Without the flag the QUEUE_PROFILE_* macros expand to nothing.
+
+typedef enum {
+    QUEUE_PROFILE_LL_PUSH,
+    QUEUE_PROFILE_LL_POP,
+    QUEUE_PROFILE_BL_PUSH,
+    QUEUE_PROFILE_BL_POP,
+    QUEUE_PROFILE_NUM_SITES
+} QueueProfileSite;
+
+typedef enum {
+    QUEUE_PROFILE_PROTECT,  //HazardPointer_protect and re-reading the protected pointer.
+    QUEUE_PROFILE_INDEX,    //fetch_add on push_idx/pop_idx.
+    QUEUE_PROFILE_EXCHANGE, //Slot or item exchange.
+    QUEUE_PROFILE_ALLOC,    //Node malloc and initialization.
+    QUEUE_PROFILE_CAS,      //Head/tail CAS, linking the new node, freeing a node that lost.
+    QUEUE_PROFILE_RETIRE,   //HazardPointer_retire, including scans.
+    QUEUE_PROFILE_CLEAR,    //HazardPointer_clear and returning.
+    QUEUE_PROFILE_BACKOFF,  //Pausing before a retry, see QueueBackoff.h.
+    QUEUE_PROFILE_NUM_PHASES
+} QueueProfilePhase;
+
+typedef struct QueueProfileThread {
+    struct QueueProfileThread* next;
+    uint64_t ops[QUEUE_PROFILE_NUM_SITES];
+    uint64_t cycles[QUEUE_PROFILE_NUM_SITES][QUEUE_PROFILE_NUM_PHASES];
+    uint64_t laps[QUEUE_PROFILE_NUM_SITES][QUEUE_PROFILE_NUM_PHASES];
+} QueueProfileThread;
+
+extern const char* QueueProfile_site_names[QUEUE_PROFILE_NUM_SITES];
+extern const char* QueueProfile_phase_names[QUEUE_PROFILE_NUM_PHASES];
+
+//True if the queues were built with phase profiling.
+bool QueueProfile_enabled(void);
+//This thread's totals, created on first use.
+QueueProfileThread* QueueProfile_thread(void);
+//Prints the totals of all threads so far; called automatically at exit once anything was recorded.
+void QueueProfile_print(FILE* out);
+
+#ifdef QUEUE_PROFILE
+#include <threads.h>
+#include "Timing.h"
+
+extern thread_local QueueProfileThread* QueueProfile_current;
+
+static inline uint64_t QueueProfile_lap(QueueProfileSite site, QueueProfilePhase phase, uint64_t since) {
+    QueueProfileThread* t = QueueProfile_current ? QueueProfile_current : QueueProfile_thread();
+    uint64_t now = Timing_cycles();
+    t->cycles[site][phase] += now - since;
+    t->laps[site][phase]++;
+    return now;
+}
+
+#define QUEUE_PROFILE_BEGIN() uint64_t queue_profile_t = Timing_cycles()
+#define QUEUE_PROFILE_LAP(site, phase) (queue_profile_t = QueueProfile_lap((site), (phase), queue_profile_t))
+#define QUEUE_PROFILE_END(site) (QueueProfile_current->ops[site]++)
+#else
+#define QUEUE_PROFILE_BEGIN() ((void)0)
+#define QUEUE_PROFILE_LAP(site, phase) ((void)0)
+#define QUEUE_PROFILE_END(site) ((void)0)
+#endif
@@ -0,0 +1,59 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "QueueStats.h"
+#include "Timing.h"
+
+static _Atomic int next_shard = 0;
+static thread_local int _shard = -1;
+_Atomic bool QueueStats_shards_shared = false;
+
+int QueueStats_shard(void) {
+    if (_shard < 0) {
+        int shard = atomic_fetch_add(&next_shard, 1);
+        if (shard >= QUEUE_STATS_SHARDS) atomic_store(&QueueStats_shards_shared, true);
+        _shard = shard % QUEUE_STATS_SHARDS;
+    }
+    return _shard;
+}
+
+void QueueStats_init(QueueStatsShard* shards) {
+    for (int i = 0; i < QUEUE_STATS_SHARDS; i++) {
+#define QUEUE_STATS_X(name) atomic_init(&shards[i].name, 0);
+        QUEUE_STATS_FIELDS(QUEUE_STATS_X)
+#undef QUEUE_STATS_X
+    }
+}
+
+//With shards == NULL (counters compiled out) stats is just zeroed.
+void QueueStats_collect(const QueueStatsShard* shards, QueueStats* stats) {
+    memset(stats, 0, sizeof(QueueStats));
+    if (shards == NULL) return;
+    for (int i = 0; i < QUEUE_STATS_SHARDS; i++) {
+#define QUEUE_STATS_X(name) stats->name += atomic_load_explicit(&shards[i].name, memory_order_relaxed);
+        QUEUE_STATS_FIELDS(QUEUE_STATS_X)
+#undef QUEUE_STATS_X
+    }
+}
+
+void QueueStats_lock(QueueStatsShard* shards, pthread_mutex_t* mtx) {
+    QueueStatsShard* shard = &shards[QueueStats_shard()];
+    if (pthread_mutex_trylock(mtx) != 0) {
+        uint64_t start = Timing_now_ns();
+        pthread_mutex_lock(mtx);
+        atomic_fetch_add_explicit(&shard->lock_wait_ns, Timing_now_ns() - start, memory_order_relaxed);
+        atomic_fetch_add_explicit(&shard->lock_contended, 1, memory_order_relaxed);
+    }
+    atomic_fetch_add_explicit(&shard->lock_acquisitions, 1, memory_order_relaxed);
+}
+
+void QueueStats_print(FILE* out, const char* prefix, const QueueStats* stats) {
+    fprintf(out, "%s", prefix);
+#define QUEUE_STATS_X(name) if (stats->name) fprintf(out, " " #name "=%lu", (unsigned long)stats->name);
+    QUEUE_STATS_FIELDS(QUEUE_STATS_X)
+#undef QUEUE_STATS_X
+    if (stats->iterations > stats->operations) {
+        fprintf(out, " retries=%lu", (unsigned long)(stats->iterations - stats->operations));
+    }
+    fprintf(out, "\n");
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <threads.h>
+
+//Memory held by one queue, as reported by <queue>_memory_usage(). Allocator headers are not included.
+//The node list is walked, so the call costs O(length): the mutex queues hold the pop mutex meanwhile and
+//may be used concurrently; LLQueue/BLQueue must not run it concurrently with pop or is_empty.
+typedef struct QueueMemoryUsage {
+    size_t node_bytes;     //Nodes still linked into the queue, including unused buffer space and the dummy node.
+    size_t retired_bytes;  //Nodes unlinked from the queue but not yet freed.
+    size_t overhead_bytes; //The queue structure itself and reclamation bookkeeping.
+} QueueMemoryUsage;
+
+//Contention counters, compiled in only with -DQUEUE_STATS (CMake option QUEUE_STATS).
+//Every queue keeps QUEUE_STATS_SHARDS cache-line-aligned shards and each thread bumps its own,
+//so counting adds no shared-line traffic; <queue>_stats() sums the shards.
+//Without QUEUE_STATS the shards are not declared and QUEUE_STAT_ADD expands to nothing.
+
+#define QUEUE_STATS_SHARDS 128
+
+#define QUEUE_STATS_FIELDS(X)                                                         \
+    X(operations)         /*push/pop/is_empty calls*/                                 \
+    X(iterations)         /*passes through retry loops; retries = iterations - operations*/ \
+    X(cas_failures)       /*failed compare_exchange on head, tail or next*/           \
+    X(empty_slot_retries) /*pop/is_empty read an EMPTY_VALUE that was not the end of the queue*/ \
+    X(wasted_slots)       /*buffer slots turned into TAKEN_VALUE without delivering a value*/ \
+    X(node_allocs)                                                                    \
+    X(node_frees)         /*immediate frees, retired nodes are counted by HazardPointer*/ \
+    X(nodes_discarded)    /*nodes allocated and freed after losing a race*/           \
+    X(head_advances)                                                                  \
+    X(tail_advances)                                                                  \
+    X(backoff_spins)      /*pauses spent backing off before retries, see QueueBackoff.h*/ \
+    X(lock_acquisitions)                                                              \
+    X(lock_contended)     /*acquisitions that had to wait*/                           \
+    X(lock_wait_ns)
+
+typedef struct QueueStats {
+#define QUEUE_STATS_X(name) uint64_t name;
+    QUEUE_STATS_FIELDS(QUEUE_STATS_X)
+#undef QUEUE_STATS_X
+} QueueStats;
+
+typedef struct QueueStatsShard {
+#define QUEUE_STATS_X(name) _Atomic uint64_t name;
+    _Alignas(64) QUEUE_STATS_FIELDS(QUEUE_STATS_X)
+#undef QUEUE_STATS_X
+} QueueStatsShard;
+
+//Shard owned by the calling thread; assigned on first use, shared only beyond QUEUE_STATS_SHARDS threads.
+int QueueStats_shard(void);
+//Set once more than QUEUE_STATS_SHARDS threads have counted, so that shards may have several writers.
+extern _Atomic bool QueueStats_shards_shared;
+void QueueStats_init(QueueStatsShard* shards);
+//Sums all shards into stats (which is overwritten).
+void QueueStats_collect(const QueueStatsShard* shards, QueueStats* stats);
+void QueueStats_print(FILE* out, const char* prefix, const QueueStats* stats);
+//Locks mtx, counting the acquisition and, if it was held by someone else, the time spent waiting.
+void QueueStats_lock(QueueStatsShard* shards, pthread_mutex_t* mtx);
+
+#ifdef QUEUE_STATS
+
+#define QUEUE_STATS_DECLARE QueueStatsShard stats[QUEUE_STATS_SHARDS];
+#define QUEUE_STATS_INIT(queue) QueueStats_init((queue)->stats)
+#define QUEUE_STATS_COLLECT(queue, out) QueueStats_collect((queue)->stats, (out))
+
+//Load and store rather than fetch_add while every shard has one writer, which avoids a locked
+//instruction while staying race-free for concurrent readers. Once threads share shards (more than
+//QUEUE_STATS_SHARDS of them, e.g. oversubscribed runs) every thread switches to fetch_add; only
+//increments in flight at that moment may be lost.
+#define QUEUE_STAT_ADD(queue, field, n)                                               \
+    do {                                                                              \
+        _Atomic uint64_t* _counter = &(queue)->stats[QueueStats_shard()].field;       \
+        if (atomic_load_explicit(&QueueStats_shards_shared, memory_order_relaxed)) {  \
+            atomic_fetch_add_explicit(_counter, (uint64_t)(n), memory_order_relaxed); \
+        }                                                                             \
+        else {                                                                        \
+            atomic_store_explicit(_counter,                                           \
+                atomic_load_explicit(_counter, memory_order_relaxed) + (uint64_t)(n), \
+                memory_order_relaxed);                                                \
+        }                                                                             \
+    } while (0)
+
+#define QUEUE_STAT_LOCK(queue, mtx) QueueStats_lock((queue)->stats, (mtx))
+
+#else
+
+#define QUEUE_STATS_DECLARE
+#define QUEUE_STATS_INIT(queue) ((void)0)
+#define QUEUE_STATS_COLLECT(queue, out) QueueStats_collect(NULL, (out))
+#define QUEUE_STAT_ADD(queue, field, n) ((void)0)
+#define QUEUE_STAT_LOCK(queue, mtx) pthread_mutex_lock(mtx)
+
+#endif
@@ -0,0 +1,110 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <threads.h>
+
+#include "QueueTrace.h"
+#include "Timing.h"
+
+typedef struct TraceEvent {
+    uint64_t timestamp; //Timing_cycles ticks.
+    const char* name;
+    uint64_t arg;
+    char phase;
+} TraceEvent;
+
+typedef struct TraceRing {
+    struct TraceRing* next; //All rings ever created, newest first.
+    int tid;
+    _Atomic uint64_t count; //Events recorded; the ring holds the last QUEUE_TRACE_RING_SIZE of them.
+    TraceEvent events[QUEUE_TRACE_RING_SIZE];
+} TraceRing;
+
+static _Atomic(TraceRing*) rings = NULL;
+static _Atomic int next_tid = 0;
+static thread_local TraceRing* my_ring = NULL;
+
+bool QueueTrace_enabled(void) {
+#ifdef QUEUE_TRACE
+    return true;
+#else
+    return false;
+#endif
+}
+
+//Rings outlive their threads so that a dump after the threads exit still sees their events.
+static TraceRing* ring_new(void) {
+    TraceRing* ring = malloc(sizeof(TraceRing));
+    assert(ring);
+    ring->tid = atomic_fetch_add(&next_tid, 1);
+    atomic_init(&ring->count, 0);
+
+    TraceRing* head = atomic_load(&rings);
+    do {
+        ring->next = head;
+    } while (!atomic_compare_exchange_weak(&rings, &head, ring));
+    return ring;
+}
+
+void QueueTrace_record(const char* name, char phase, uint64_t arg) {
+    TraceRing* ring = my_ring;
+    if (ring == NULL) ring = my_ring = ring_new();
+
+    uint64_t n = atomic_load_explicit(&ring->count, memory_order_relaxed);
+    TraceEvent* e = &ring->events[n & (QUEUE_TRACE_RING_SIZE - 1)];
+    e->timestamp = Timing_cycles();
+    e->name = name;
+    e->arg = arg;
+    e->phase = phase;
+    atomic_store_explicit(&ring->count, n + 1, memory_order_release);
+}
+
+void QueueTrace_reset(void) {
+    for (TraceRing* ring = atomic_load(&rings); ring != NULL; ring = ring->next) {
+        atomic_store(&ring->count, 0);
+    }
+}
+
+bool QueueTrace_dump(const char* path) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    //Timestamps are shown relative to the oldest event still held by any ring.
+    uint64_t origin = UINT64_MAX;
+    for (TraceRing* ring = atomic_load(&rings); ring != NULL; ring = ring->next) {
+        uint64_t n = atomic_load_explicit(&ring->count, memory_order_acquire);
+        if (n == 0) continue;
+        uint64_t first = n > QUEUE_TRACE_RING_SIZE ? n - QUEUE_TRACE_RING_SIZE : 0;
+        uint64_t ts = ring->events[first & (QUEUE_TRACE_RING_SIZE - 1)].timestamp;
+        if (ts < origin) origin = ts;
+    }
+    double ticks_per_us = Timing_cycles_per_ns() * 1000.0;
+
+    fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    bool first_event = true;
+    for (TraceRing* ring = atomic_load(&rings); ring != NULL; ring = ring->next) {
+        uint64_t n = atomic_load_explicit(&ring->count, memory_order_acquire);
+        uint64_t first = n > QUEUE_TRACE_RING_SIZE ? n - QUEUE_TRACE_RING_SIZE : 0;
+        for (uint64_t i = first; i < n; i++) {
+            const TraceEvent* e = &ring->events[i & (QUEUE_TRACE_RING_SIZE - 1)];
+            double ts = (e->timestamp - origin) / ticks_per_us;
+            fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d",
+                    first_event ? "" : ",\n", e->name, e->phase, ts, ring->tid);
+            if (e->phase == 'i') fprintf(f, ",\"s\":\"t\",\"args\":{\"arg\":\"0x%llx\"}", (unsigned long long)e->arg);
+            fprintf(f, "}");
+            first_event = false;
+        }
+    }
+    fprintf(f, "\n]}\n");
+
+    bool ok = !ferror(f);
+    if (fclose(f) != 0) ok = false;
+    if (!ok) fprintf(stderr, "%s: write failed\n", path);
+    return ok;
+}
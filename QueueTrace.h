@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//Event tracing, compiled in only with -DQUEUE_TRACE (CMake option QUEUE_TRACE).
+//Every thread records into its own ring of QUEUE_TRACE_RING_SIZE events (the oldest are
+//overwritten), so recording is a few plain stores with no shared writes. QueueTrace_dump
+//writes all rings as Chrome trace_event JSON, viewable in Perfetto or chrome://tracing.
+//Without the flag the QUEUE_TRACE_* macros expand to nothing.
+
+#define QUEUE_TRACE_RING_SIZE (1 << 16)
+
+//True if the queues were built with trace points.
+bool QueueTrace_enabled(void);
+//Records an event; phase is 'B' (begin), 'E' (end) or 'i' (instant). name must be a string literal.
+void QueueTrace_record(const char* name, char phase, uint64_t arg);
+//Writes every thread's events recorded so far; call when the traced threads are quiescent.
+//Returns false after printing the reason to stderr.
+bool QueueTrace_dump(const char* path);
+//Drops all recorded events; threads keep their rings.
+void QueueTrace_reset(void);
+
+#ifdef QUEUE_TRACE
+#define QUEUE_TRACE_BEGIN(name) QueueTrace_record((name), 'B', 0)
+#define QUEUE_TRACE_END(name) QueueTrace_record((name), 'E', 0)
+#define QUEUE_TRACE_EVENT(name, arg) QueueTrace_record((name), 'i', (uint64_t)(uintptr_t)(arg))
+#else
+#define QUEUE_TRACE_BEGIN(name) ((void)0)
+#define QUEUE_TRACE_END(name) ((void)0)
+#define QUEUE_TRACE_EVENT(name, arg) ((void)0)
+#endif
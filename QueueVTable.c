@@ -0,0 +1,31 @@
+#include <stddef.h>
+#include <string.h>
+
+#include "BLQueue.h"
+#include "LLQueue.h"
+#include "QueueVTable.h"
+#include "RingsQueue.h"
+#include "SimpleQueue.h"
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wincompatible-pointer-types"
+
+const QueueVTable queueVTables[] = {
+    { "SimpleQueue", SimpleQueue_new, SimpleQueue_push, SimpleQueue_pop, SimpleQueue_is_empty, SimpleQueue_delete, SimpleQueue_stats, SimpleQueue_memory_usage, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL },
+    { "RingsQueue", RingsQueue_new, RingsQueue_push, RingsQueue_pop, RingsQueue_is_empty, RingsQueue_delete, RingsQueue_stats, RingsQueue_memory_usage, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL },
+    { "LLQueue", LLQueue_new, LLQueue_push, LLQueue_pop, LLQueue_is_empty, LLQueue_delete, LLQueue_stats, LLQueue_memory_usage, LLQueue_hazard_stats, LLQueue_new_with_scheme, LLQueue_new_shared, LLQueue_set_backoff,
+      LLQueue_handle, LLQueue_push_with, LLQueue_pop_with, LLQueue_is_empty_with },
+    { "BLQueue", BLQueue_new, BLQueue_push, BLQueue_pop, BLQueue_is_empty, BLQueue_delete, BLQueue_stats, BLQueue_memory_usage, BLQueue_hazard_stats, BLQueue_new_with_scheme, BLQueue_new_shared, BLQueue_set_backoff,
+      BLQueue_handle, BLQueue_push_with, BLQueue_pop_with, BLQueue_is_empty_with }
+};
+
+#pragma GCC diagnostic pop
+
+const int queueVTables_count = sizeof(queueVTables) / sizeof(QueueVTable);
+
+const QueueVTable* QueueVTable_find(const char* name) {
+    for (int i = 0; i < queueVTables_count; i++) {
+        if (strcmp(queueVTables[i].name, name) == 0) return &queueVTables[i];
+    }
+    return NULL;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "QueueStats.h"
+#include "common.h"
+
+struct HazardPointer;
+struct HazardPointer_Handle;
+struct HazardPointer_Stats;
+
+// A structure holding function pointers to methods of some queue type.
+struct QueueVTable {
+    const char* name;
+    void* (*new)(void);
+    void (*push)(void* queue, Value item);
+    Value (*pop)(void* queue);
+    bool (*is_empty)(void* queue);
+    void (*delete)(void* queue);
+    void (*stats)(void* queue, QueueStats* stats);
+    void (*memory_usage)(void* queue, QueueMemoryUsage* usage);
+    void (*hazard_stats)(void* queue, struct HazardPointer_Stats* stats); //NULL for queues without HazardPointer.
+    void* (*new_with_scheme)(int scheme); //Takes a ReclamationScheme; NULL for queues without HazardPointer.
+    void* (*new_shared)(struct HazardPointer* hp); //NULL for queues without HazardPointer.
+    void (*set_backoff)(void* queue, int policy); //Takes a QueueBackoffPolicy; NULL for the mutex queues.
+    //Operations through a per-thread HazardPointer_Handle; all NULL for queues without HazardPointer.
+    void (*handle)(void* queue, struct HazardPointer_Handle* handle);
+    void (*push_with)(void* queue, struct HazardPointer_Handle* handle, Value item);
+    Value (*pop_with)(void* queue, struct HazardPointer_Handle* handle);
+    bool (*is_empty_with)(void* queue, struct HazardPointer_Handle* handle);
+};
+typedef struct QueueVTable QueueVTable;
+
+extern const QueueVTable queueVTables[];
+extern const int queueVTables_count;
+
+//Returns the vtable with the given name, or NULL if there is none.
+const QueueVTable* QueueVTable_find(const char* name);
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+#include <threads.h>
+
+//xorshift64*, cheap per-thread random numbers for delays and backoff; not for statistics.
+//The state is per thread (and per file using it), seeded from its own address.
+static inline uint32_t Random_next(void) {
+    static thread_local uint64_t state = 0;
+    if (state == 0) state = (uint64_t)(uintptr_t)&state * 0x9e3779b97f4a7c15ull | 1;
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return (uint32_t)((state * 0x2545f4914f6cdd1dull) >> 32);
+}
@@ -7,35 +7,43 @@
 #include <stdlib.h>
 
 #include "HazardPointer.h"
+#include "QueueDelay.h"
+#include "QueueOrder.h"
 #include "RingsQueue.h"
 
 struct RingsQueueNode;
 typedef struct RingsQueueNode RingsQueueNode;
 
 
+//push_idx is only touched by the producer holding push_mtx, pop_idx by the consumer holding pop_mtx
+//and free_slots by both, so each has its own cache line.
+//Memory orders: the producer and the consumer hold different mutexes, so free_slots hands slots over.
+//The producer writes a slot and releases it by decrementing free_slots; the consumer acquires that
+//before reading the slot and releases it back by incrementing, which the producer acquires before
+//writing it again. A node is published by a release store of next and an acquire load.
 struct RingsQueueNode {
     _Atomic(RingsQueueNode*) next;
-    Value buffer[RING_SIZE];
-    int push_idx; 
-    int pop_idx; 
-    _Atomic int free_slots; 
+    _Alignas(64) int push_idx;
+    _Alignas(64) int pop_idx;
+    _Alignas(64) _Atomic int free_slots;
+    _Alignas(64) Value buffer[RING_SIZE];
 };
 
 Value getValue(RingsQueueNode* node) {
     Value val = node->buffer[node->pop_idx];
     node->pop_idx = ((node->pop_idx + 1) % RING_SIZE);
-    atomic_fetch_add(&(node->free_slots), 1);
+    atomic_fetch_add_explicit(&(node->free_slots), 1, QUEUE_RELEASE);
     return val;
 }
 
 void pushValue(RingsQueueNode* node, Value val) {
     node->buffer[node->push_idx] = val;
     node->push_idx = ((node->push_idx + 1) % RING_SIZE);
-    atomic_fetch_sub(&(node->free_slots), 1);
+    atomic_fetch_sub_explicit(&(node->free_slots), 1, QUEUE_RELEASE);
 }
 
 RingsQueueNode* RingsQueueNode_new() {
-    RingsQueueNode* node = (RingsQueueNode*)malloc(sizeof(RingsQueueNode));
+    RingsQueueNode* node = (RingsQueueNode*)aligned_alloc(_Alignof(RingsQueueNode), sizeof(RingsQueueNode));
     assert(node != NULL);
     node->push_idx = 0; 
     node->pop_idx = 0;
@@ -44,20 +52,23 @@ RingsQueueNode* RingsQueueNode_new() {
     return node; 
 }
 
+//Consumer side (head, pop_mtx) and producer side (tail, push_mtx) on separate cache lines.
 struct RingsQueue {
-    RingsQueueNode* head;
-    RingsQueueNode* tail;
+    _Alignas(64) RingsQueueNode* head;
     pthread_mutex_t pop_mtx;
+    _Alignas(64) RingsQueueNode* tail;
     pthread_mutex_t push_mtx;
+    QUEUE_STATS_DECLARE
 };
 
 RingsQueue* RingsQueue_new(void) {
-    RingsQueue* queue = (RingsQueue*)malloc(sizeof(RingsQueue));
+    RingsQueue* queue = (RingsQueue*)aligned_alloc(_Alignof(RingsQueue), sizeof(RingsQueue));
     RingsQueueNode* node = RingsQueueNode_new();
     queue->head = node;
     queue->tail = node; 
     pthread_mutex_init(&queue->pop_mtx, NULL);
     pthread_mutex_init(&queue->push_mtx, NULL);
+    QUEUE_STATS_INIT(queue);
     return queue;
 }
 
@@ -66,7 +77,7 @@ void RingsQueue_delete(RingsQueue* queue) {
     pthread_mutex_destroy(&queue->push_mtx);
     RingsQueueNode* node = queue->head;
     while(node != NULL) {
-        RingsQueueNode* next = atomic_load(&node->next);
+        RingsQueueNode* next = atomic_load_explicit(&node->next, QUEUE_RELAXED); //Single-threaded.
         free(node);
         node = next;
     }
@@ -74,7 +85,7 @@ void RingsQueue_delete(RingsQueue* queue) {
 }
 
 RingsQueueNode* RingsQueueNode_new_with_value(Value val) {
-    RingsQueueNode* node = (RingsQueueNode*)malloc(sizeof(RingsQueueNode));
+    RingsQueueNode* node = (RingsQueueNode*)aligned_alloc(_Alignof(RingsQueueNode), sizeof(RingsQueueNode));
     assert(node != NULL);
     node->buffer[0] = val;
     node->push_idx = 1; 
@@ -85,16 +96,20 @@ RingsQueueNode* RingsQueueNode_new_with_value(Value val) {
 }
 
 void RingsQueue_push(RingsQueue* queue, Value item) {
-    pthread_mutex_lock(&queue->push_mtx);
+    QUEUE_STAT_ADD(queue, operations, 1);
+    QUEUE_STAT_LOCK(queue, &queue->push_mtx);
+    QUEUE_DELAY_POINT(QUEUE_DELAY_LOCK_HELD);
 
-    if (atomic_load(&queue->tail->free_slots) > 0) {
+    if (atomic_load_explicit(&queue->tail->free_slots, QUEUE_ACQUIRE) > 0) {
         pushValue(queue->tail, item);
     }
     //Last node full. 
     else {
         RingsQueueNode* new_tail = RingsQueueNode_new_with_value(item);
-        atomic_store(&queue->tail->next, new_tail);
+        atomic_store_explicit(&queue->tail->next, new_tail, QUEUE_RELEASE);
         queue->tail = new_tail;
+        QUEUE_STAT_ADD(queue, node_allocs, 1);
+        QUEUE_STAT_ADD(queue, tail_advances, 1);
     }
 
    pthread_mutex_unlock(&queue->push_mtx);
@@ -102,22 +117,27 @@ void RingsQueue_push(RingsQueue* queue, Value item) {
 
 Value RingsQueue_pop(RingsQueue* queue) {
     Value val = EMPTY_VALUE;
+    QUEUE_STAT_ADD(queue, operations, 1);
 
-    pthread_mutex_lock(&(queue->pop_mtx));
+    QUEUE_STAT_LOCK(queue, &(queue->pop_mtx));
+    QUEUE_DELAY_POINT(QUEUE_DELAY_LOCK_HELD);
     RingsQueueNode* head = queue->head; 
 
     //When head empty and has next node.
-    if (atomic_load(&head->next) != NULL && 
-        atomic_load(&head->free_slots) == RING_SIZE) {
-            RingsQueueNode* new_head = atomic_load(&head->next);
+    RingsQueueNode* next = atomic_load_explicit(&head->next, QUEUE_ACQUIRE);
+    if (next != NULL && 
+        atomic_load_explicit(&head->free_slots, QUEUE_ACQUIRE) == RING_SIZE) {
+            RingsQueueNode* new_head = next;
             //Take the first element from node (new head). 
             free(head); 
             queue->head = new_head;
+            QUEUE_STAT_ADD(queue, node_frees, 1);
+            QUEUE_STAT_ADD(queue, head_advances, 1);
             val = getValue(new_head);
     }
 
     //Head not empty.
-    else if (atomic_load(&head->free_slots) < RING_SIZE) {
+    else if (atomic_load_explicit(&head->free_slots, QUEUE_ACQUIRE) < RING_SIZE) {
         val = getValue(head);
     }
 
@@ -129,11 +149,29 @@ Value RingsQueue_pop(RingsQueue* queue) {
 
 bool RingsQueue_is_empty(RingsQueue* queue) {
     bool empty = true;
-    pthread_mutex_lock(&(queue->pop_mtx));
+    QUEUE_STAT_ADD(queue, operations, 1);
+    QUEUE_STAT_LOCK(queue, &(queue->pop_mtx));
     RingsQueueNode* head = queue->head; 
-    if (atomic_load(&head->free_slots) < RING_SIZE || atomic_load(&head->next) != NULL) {
+    //Only the answer is used, so relaxed.
+    if (atomic_load_explicit(&head->free_slots, QUEUE_RELAXED) < RING_SIZE
+        || atomic_load_explicit(&head->next, QUEUE_RELAXED) != NULL) {
         empty = false;
     }
     pthread_mutex_unlock(&(queue->pop_mtx));
     return empty;
 }
+
+void RingsQueue_stats(RingsQueue* queue, QueueStats* stats) {
+    QUEUE_STATS_COLLECT(queue, stats);
+}
+
+void RingsQueue_memory_usage(RingsQueue* queue, QueueMemoryUsage* usage) {
+    size_t nodes = 0;
+    pthread_mutex_lock(&queue->pop_mtx);
+    for (RingsQueueNode* node = queue->head; node != NULL; node = atomic_load_explicit(&node->next, QUEUE_ACQUIRE)) nodes++;
+    pthread_mutex_unlock(&queue->pop_mtx);
+
+    usage->node_bytes = nodes * sizeof(RingsQueueNode);
+    usage->retired_bytes = 0;
+    usage->overhead_bytes = sizeof(RingsQueue);
+}
@@ -2,9 +2,13 @@
 
 #include <stdbool.h>
 
+#include "QueueStats.h"
 #include "common.h"
 
+//Values per ring; can be overridden at build time (CMake cache entry QUEUE_RING_SIZE, see autotune.sh).
+#ifndef RING_SIZE
 #define RING_SIZE 1024
+#endif
 
 struct RingsQueue;
 typedef struct RingsQueue RingsQueue;
@@ -14,3 +18,6 @@ void RingsQueue_delete(RingsQueue* queue);
 void RingsQueue_push(RingsQueue* queue, Value item);
 Value RingsQueue_pop(RingsQueue* queue);
 bool RingsQueue_is_empty(RingsQueue* queue);
+//Sums the contention counters of all threads; all zero unless built with QUEUE_STATS.
+void RingsQueue_stats(RingsQueue* queue, QueueStats* stats);
+void RingsQueue_memory_usage(RingsQueue* queue, QueueMemoryUsage* usage);
@@ -3,11 +3,15 @@
 #include <stdatomic.h>
 #include <stdlib.h>
 #include <assert.h>
+#include "QueueDelay.h"
+#include "QueueOrder.h"
 #include "SimpleQueue.h"
 
 struct SimpleQueueNode;
 typedef struct SimpleQueueNode SimpleQueueNode;
 
+//Memory orders: head and tail are guarded by their mutexes, but a producer and a consumer hold different
+//ones, so next is what publishes a node: a release store by push and an acquire load by pop.
 struct SimpleQueueNode {
     _Atomic(SimpleQueueNode*) next;
     Value item;
@@ -21,19 +25,22 @@ SimpleQueueNode* SimpleQueueNode_new(Value item) {
     return node;
 }
 
+//Consumer side (head, head_mtx) and producer side (tail, tail_mtx) on separate cache lines.
 struct SimpleQueue {
-    SimpleQueueNode* head;
-    SimpleQueueNode* tail;
+    _Alignas(64) SimpleQueueNode* head;
     pthread_mutex_t head_mtx;
+    _Alignas(64) SimpleQueueNode* tail;
     pthread_mutex_t tail_mtx;
+    QUEUE_STATS_DECLARE
 };
 
 SimpleQueue* SimpleQueue_new(void)
 {
-    SimpleQueue* queue = (SimpleQueue*)malloc(sizeof(SimpleQueue));
+    SimpleQueue* queue = (SimpleQueue*)aligned_alloc(_Alignof(SimpleQueue), sizeof(SimpleQueue));
     assert(queue != NULL);
     pthread_mutex_init(&queue->head_mtx, NULL);
     pthread_mutex_init(&queue->tail_mtx, NULL);
+    QUEUE_STATS_INIT(queue);
     SimpleQueueNode* node = SimpleQueueNode_new(EMPTY_VALUE);
     queue->head = node; 
     queue->tail = node;
@@ -47,7 +54,7 @@ void SimpleQueue_delete(SimpleQueue* queue) {
     pthread_mutex_destroy(&queue->tail_mtx);
     SimpleQueueNode* node = queue->head;
     while (node != NULL) {
-        SimpleQueueNode* next = atomic_load(&node->next);
+        SimpleQueueNode* next = atomic_load_explicit(&node->next, QUEUE_RELAXED);
         free(node);
         node = next;
     }
@@ -56,17 +63,23 @@ void SimpleQueue_delete(SimpleQueue* queue) {
 
 void SimpleQueue_push(SimpleQueue* queue, Value item) {
     SimpleQueueNode* new_node = SimpleQueueNode_new(item); 
+    QUEUE_STAT_ADD(queue, operations, 1);
+    QUEUE_STAT_ADD(queue, node_allocs, 1);
 
-    pthread_mutex_lock(&queue->tail_mtx); 
-    atomic_store(&(queue->tail->next), new_node);
+    QUEUE_STAT_LOCK(queue, &queue->tail_mtx); 
+    QUEUE_DELAY_POINT(QUEUE_DELAY_LOCK_HELD);
+    atomic_store_explicit(&(queue->tail->next), new_node, QUEUE_RELEASE);
     queue->tail = new_node;
+    QUEUE_STAT_ADD(queue, tail_advances, 1);
     pthread_mutex_unlock(&queue->tail_mtx); 
 }
 
 Value SimpleQueue_pop(SimpleQueue* queue) {
-    pthread_mutex_lock(&queue->head_mtx);
+    QUEUE_STAT_ADD(queue, operations, 1);
+    QUEUE_STAT_LOCK(queue, &queue->head_mtx);
+    QUEUE_DELAY_POINT(QUEUE_DELAY_LOCK_HELD);
     SimpleQueueNode* old_head = queue->head;  
-    SimpleQueueNode* new_head = atomic_load(&(old_head->next));
+    SimpleQueueNode* new_head = atomic_load_explicit(&(old_head->next), QUEUE_ACQUIRE);
 
     //No elements in the list.
     if (new_head == NULL) {
@@ -76,18 +89,34 @@ Value SimpleQueue_pop(SimpleQueue* queue) {
     //Get the value, replace old_head with new_value.
     Value val = new_head->item;
     queue->head = new_head;
+    QUEUE_STAT_ADD(queue, head_advances, 1);
     pthread_mutex_unlock(&queue->head_mtx); 
     //Free old
     free(old_head);
+    QUEUE_STAT_ADD(queue, node_frees, 1);
     return val;
 }
 
 bool SimpleQueue_is_empty(SimpleQueue* queue) {
     bool empty = false; 
-    pthread_mutex_lock(&queue->head_mtx); 
-    empty = (atomic_load(&(queue->head->next)) == NULL);
+    QUEUE_STAT_ADD(queue, operations, 1);
+    QUEUE_STAT_LOCK(queue, &queue->head_mtx); 
+    empty = (atomic_load_explicit(&(queue->head->next), QUEUE_RELAXED) == NULL); //Only the answer is used.
     pthread_mutex_unlock(&queue->head_mtx); 
     return empty;
 }
 
+void SimpleQueue_stats(SimpleQueue* queue, QueueStats* stats) {
+    QUEUE_STATS_COLLECT(queue, stats);
+}
 
+void SimpleQueue_memory_usage(SimpleQueue* queue, QueueMemoryUsage* usage) {
+    size_t nodes = 0;
+    pthread_mutex_lock(&queue->head_mtx);
+    for (SimpleQueueNode* node = queue->head; node != NULL; node = atomic_load_explicit(&node->next, QUEUE_ACQUIRE)) nodes++;
+    pthread_mutex_unlock(&queue->head_mtx);
+
+    usage->node_bytes = nodes * sizeof(SimpleQueueNode);
+    usage->retired_bytes = 0;
+    usage->overhead_bytes = sizeof(SimpleQueue);
+}
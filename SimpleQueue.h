@@ -2,6 +2,7 @@
 
 #include <stdbool.h>
 
+#include "QueueStats.h"
 #include "common.h"
 
 struct SimpleQueue;
@@ -12,3 +13,6 @@ void SimpleQueue_delete(SimpleQueue* queue);
 void SimpleQueue_push(SimpleQueue* queue, Value item);
 Value SimpleQueue_pop(SimpleQueue* queue);
 bool SimpleQueue_is_empty(SimpleQueue* queue);
+//Sums the contention counters of all threads; all zero unless built with QUEUE_STATS.
+void SimpleQueue_stats(SimpleQueue* queue, QueueStats* stats);
+void SimpleQueue_memory_usage(SimpleQueue* queue, QueueMemoryUsage* usage);
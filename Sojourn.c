@@ -0,0 +1,45 @@
+#include "Sojourn.h"
+#include "Timing.h"
+
+//Stamp layout: (ticks since origin + 1) << 5 | depth class. It is positive and nonzero,
+//so it never collides with EMPTY_VALUE or TAKEN_VALUE.
+#define CLASS_BITS 5
+
+_Static_assert(SOJOURN_DEPTH_CLASSES <= (1 << CLASS_BITS), "depth class must fit in the stamp");
+
+void SojournQueue_init(SojournQueue* sq, const QueueVTable* Q, void* queue) {
+    sq->Q = Q;
+    sq->queue = queue;
+    sq->origin = Timing_cycles();
+    atomic_init(&sq->pushed, 0);
+    atomic_init(&sq->popped, 0);
+}
+
+int Sojourn_depth_class(uint64_t depth) {
+    if (depth == 0) return 0;
+    int c = 64 - __builtin_clzll(depth);
+    return c < SOJOURN_DEPTH_CLASSES ? c : SOJOURN_DEPTH_CLASSES - 1;
+}
+
+uint64_t Sojourn_class_min(int c) {
+    return c == 0 ? 0 : 1ull << (c - 1);
+}
+
+void SojournQueue_push(SojournQueue* sq) {
+    uint64_t ahead = atomic_fetch_add_explicit(&sq->pushed, 1, memory_order_relaxed);
+    uint64_t gone = atomic_load_explicit(&sq->popped, memory_order_relaxed);
+    int c = Sojourn_depth_class(ahead > gone ? ahead - gone : 0);
+    uint64_t ticks = Timing_cycles() - sq->origin + 1;
+    sq->Q->push(sq->queue, (Value)(ticks << CLASS_BITS | (uint64_t)c));
+}
+
+Value SojournQueue_pop(SojournQueue* sq, Histogram* by_depth) {
+    Value stamp = sq->Q->pop(sq->queue);
+    if (stamp == EMPTY_VALUE) return stamp;
+    uint64_t now = Timing_cycles() - sq->origin + 1;
+    atomic_fetch_add_explicit(&sq->popped, 1, memory_order_relaxed);
+
+    uint64_t pushed_at = (uint64_t)stamp >> CLASS_BITS;
+    Histogram_record(&by_depth[stamp & ((1 << CLASS_BITS) - 1)], now > pushed_at ? now - pushed_at : 0);
+    return stamp;
+}
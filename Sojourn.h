@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "Histogram.h"
+#include "QueueVTable.h"
+#include "common.h"
+
+//Sojourn (residence) time: how long an item waits in a queue between its push and its pop.
+//SojournQueue wraps any queue from queueVTables and pushes stamps instead of items: a stamp holds
+//the push time and the class of the queue depth at that moment, and a pop records the elapsed time
+//in that class's histogram. The depth is the difference of two shared counters, so every item
+//costs two extra atomic increments - fine for measuring delay, not for comparing raw throughput.
+
+//Class 0 is an empty queue, class c > 0 depths in [2^(c-1), 2^c); the last class is open-ended.
+#define SOJOURN_DEPTH_CLASSES 24
+
+typedef struct SojournQueue {
+    const QueueVTable* Q;
+    void* queue;
+    uint64_t origin; //Timing_cycles when the wrapper was initialized; stamps are relative to it.
+    _Alignas(64) _Atomic uint64_t pushed;
+    _Alignas(64) _Atomic uint64_t popped;
+} SojournQueue;
+
+//Wraps queue, which must be empty and not be used directly while wrapped.
+void SojournQueue_init(SojournQueue* sq, const QueueVTable* Q, void* queue);
+//Pushes a stamp in place of an item.
+void SojournQueue_push(SojournQueue* sq);
+//Pops a stamp and records its sojourn time in Timing_cycles ticks into by_depth[class], an array
+//of SOJOURN_DEPTH_CLASSES histograms owned by the calling thread. Returns the stamp or EMPTY_VALUE.
+Value SojournQueue_pop(SojournQueue* sq, Histogram* by_depth);
+
+int Sojourn_depth_class(uint64_t depth);
+//Smallest depth in class c.
+uint64_t Sojourn_class_min(int c);
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+//Monotonic wall-clock time in nanoseconds.
+static inline uint64_t Timing_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+//Cheap timestamp for timing single operations: the TSC on x86 (lfence keeps it from
+//being reordered before earlier instructions), nanoseconds elsewhere.
+static inline uint64_t Timing_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_lfence();
+    return __rdtsc();
+#else
+    return Timing_now_ns();
+#endif
+}
+
+//Number of Timing_cycles ticks per nanosecond, measured against the monotonic clock.
+static inline double Timing_cycles_per_ns(void) {
+    static double ratio = 0;
+    if (ratio == 0) {
+        uint64_t ns0 = Timing_now_ns(), c0 = Timing_cycles();
+        struct timespec pause = { 0, 20 * 1000 * 1000 };
+        nanosleep(&pause, NULL);
+        uint64_t ns1 = Timing_now_ns(), c1 = Timing_cycles();
+        ratio = (double)(c1 - c0) / (double)(ns1 - ns0);
+    }
+    return ratio;
+}
+
+//Smallest observed cost of taking two back-to-back timestamps, in ticks.
+static inline uint64_t Timing_overhead(void) {
+    uint64_t best = UINT64_MAX;
+    for (int i = 0; i < 1000; i++) {
+        uint64_t t0 = Timing_cycles();
+        uint64_t t1 = Timing_cycles();
+        if (t1 - t0 < best) best = t1 - t0;
+    }
+    return best;
+}
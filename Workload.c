@@ -0,0 +1,148 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "HazardPointer.h"
+#include "Workload.h"
+
+const char* Workload_op_names[WORKLOAD_NUM_OPS] = { "push", "pop", "is_empty" };
+
+void Workload_init(Workload* w) {
+    w->records = NULL;
+    w->count = 0;
+    w->capacity = 0;
+    w->num_threads = 0;
+}
+
+void Workload_free(Workload* w) {
+    free(w->records);
+    Workload_init(w);
+}
+
+void Workload_append(Workload* w, int thread, WorkloadOp op, Value value, uint32_t delay_ns) {
+    if (w->count == w->capacity) {
+        w->capacity = w->capacity ? 2 * w->capacity : 1024;
+        w->records = realloc(w->records, w->capacity * sizeof(WorkloadRecord));
+        assert(w->records);
+    }
+    w->records[w->count++] = (WorkloadRecord){
+        .delay_ns = delay_ns, .thread = (uint16_t)thread, .op = (uint8_t)op, .reserved = 0, .value = value
+    };
+    if (thread + 1 > w->num_threads) w->num_threads = thread + 1;
+}
+
+static bool ends_with(const char* s, const char* suffix) {
+    size_t n = strlen(s), k = strlen(suffix);
+    return n >= k && strcmp(s + n - k, suffix) == 0;
+}
+
+static bool valid_record(const char* path, size_t index, long thread, int op, Value value, unsigned long delay) {
+    if (thread < 0 || thread >= WORKLOAD_MAX_THREADS) {
+        fprintf(stderr, "%s: record %zu: thread %ld out of range [0, %d)\n", path, index, thread, WORKLOAD_MAX_THREADS);
+        return false;
+    }
+    if (op < 0 || op >= WORKLOAD_NUM_OPS) {
+        fprintf(stderr, "%s: record %zu: unknown operation\n", path, index);
+        return false;
+    }
+    if (delay > UINT32_MAX) {
+        fprintf(stderr, "%s: record %zu: delay %lu ns above the largest recordable %lu\n", path, index, delay,
+                (unsigned long)UINT32_MAX);
+        return false;
+    }
+    if (op == WORKLOAD_PUSH && (value == EMPTY_VALUE || value == TAKEN_VALUE)) {
+        fprintf(stderr, "%s: record %zu: pushed value may not be EMPTY_VALUE or TAKEN_VALUE\n", path, index);
+        return false;
+    }
+    return true;
+}
+
+static bool load_binary(Workload* w, FILE* f, const char* path) {
+    unsigned char buf[16];
+    for (size_t i = 0; fread(buf, sizeof(buf), 1, f) == 1; i++) {
+        uint32_t delay = (uint32_t)buf[0] | (uint32_t)buf[1] << 8 | (uint32_t)buf[2] << 16 | (uint32_t)buf[3] << 24;
+        long thread = (long)(buf[4] | buf[5] << 8);
+        int op = buf[6];
+        uint64_t raw = 0;
+        for (int b = 7; b >= 0; b--) raw = raw << 8 | buf[8 + b];
+        Value value = (Value)raw;
+        if (!valid_record(path, i, thread, op, value, delay)) return false;
+        Workload_append(w, (int)thread, op, value, delay);
+    }
+    return true;
+}
+
+static bool load_csv(Workload* w, FILE* f, const char* path) {
+    char line[256];
+    size_t index = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#' || line[0] == '\n' || strncmp(line, "thread", 6) == 0) continue;
+        long thread;
+        char op_name[16];
+        long long value;
+        unsigned long delay;
+        if (sscanf(line, "%ld,%15[^,],%lld,%lu", &thread, op_name, &value, &delay) != 4) {
+            fprintf(stderr, "%s: cannot parse: %s", path, line);
+            return false;
+        }
+        int op = -1;
+        for (int k = 0; k < WORKLOAD_NUM_OPS; k++) {
+            if (strcmp(op_name, Workload_op_names[k]) == 0) op = k;
+        }
+        if (!valid_record(path, index, thread, op, (Value)value, delay)) return false;
+        Workload_append(w, (int)thread, op, (Value)value, (uint32_t)delay);
+        index++;
+    }
+    return true;
+}
+
+bool Workload_load(Workload* w, const char* path) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return false;
+    }
+    Workload_init(w);
+
+    char magic[4];
+    bool binary = fread(magic, sizeof(magic), 1, f) == 1 && memcmp(magic, WORKLOAD_MAGIC, 4) == 0;
+    if (!binary) rewind(f);
+    bool ok = binary ? load_binary(w, f, path) : load_csv(w, f, path);
+    fclose(f);
+    if (!ok) Workload_free(w);
+    return ok;
+}
+
+bool Workload_save(const Workload* w, const char* path) {
+    bool csv = ends_with(path, ".csv");
+    FILE* f = fopen(path, csv ? "w" : "wb");
+    if (!f) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    if (csv) fprintf(f, "thread,op,value,delay_ns\n");
+    else fwrite(WORKLOAD_MAGIC, 4, 1, f);
+
+    for (size_t i = 0; i < w->count; i++) {
+        const WorkloadRecord* r = &w->records[i];
+        if (csv) {
+            fprintf(f, "%u,%s,%lld,%u\n", r->thread, Workload_op_names[r->op], (long long)r->value, r->delay_ns);
+            continue;
+        }
+        unsigned char buf[16] = { 0 };
+        for (int b = 0; b < 4; b++) buf[b] = (unsigned char)(r->delay_ns >> (8 * b));
+        buf[4] = (unsigned char)r->thread;
+        buf[5] = (unsigned char)(r->thread >> 8);
+        buf[6] = r->op;
+        for (int b = 0; b < 8; b++) buf[8 + b] = (unsigned char)((uint64_t)r->value >> (8 * b));
+        fwrite(buf, sizeof(buf), 1, f);
+    }
+
+    bool ok = !ferror(f);
+    if (fclose(f) != 0) ok = false;
+    if (!ok) fprintf(stderr, "%s: write failed\n", path);
+    return ok;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "HazardPointer.h"
+#include "common.h"
+
+//A recorded or generated queue workload: a sequence of operations, each issued by a given thread
+//delay_ns after that thread's previous operation was due. Stored either as CSV
+//("thread,op,value,delay_ns" with op one of push/pop/is_empty) or in a compact binary form
+//(WORKLOAD_MAGIC, then 16-byte little-endian records); Workload_load detects which.
+
+#define WORKLOAD_MAGIC "QWL1"
+//Thread ids must fit in a record and be valid HazardPointer ids.
+#define WORKLOAD_MAX_THREADS (HAZARD_MAX_THREADS < UINT16_MAX + 1 ? HAZARD_MAX_THREADS : UINT16_MAX + 1)
+
+typedef enum { WORKLOAD_PUSH, WORKLOAD_POP, WORKLOAD_IS_EMPTY, WORKLOAD_NUM_OPS } WorkloadOp;
+
+extern const char* Workload_op_names[WORKLOAD_NUM_OPS];
+
+typedef struct WorkloadRecord {
+    uint32_t delay_ns;
+    uint16_t thread;
+    uint8_t op;
+    uint8_t reserved;
+    Value value; //Pushed value; ignored for pop and is_empty.
+} WorkloadRecord;
+
+typedef struct Workload {
+    WorkloadRecord* records;
+    size_t count;
+    size_t capacity;
+    int num_threads; //1 + largest thread id.
+} Workload;
+
+void Workload_init(Workload* w);
+void Workload_free(Workload* w);
+void Workload_append(Workload* w, int thread, WorkloadOp op, Value value, uint32_t delay_ns);
+//Both return false after printing the reason to stderr.
+bool Workload_load(Workload* w, const char* path);
+//Writes CSV if path ends in ".csv", binary otherwise.
+bool Workload_save(const Workload* w, const char* path);
@@ -0,0 +1,149 @@
+#!/bin/sh
+# Tunes BUFFER_SIZE, RING_SIZE and RETIRED_THRESHOLD for one queue and workload: builds queueBench for
+# every point of the grid of parameters that matter to that queue, runs the workload on each build and
+# writes the best values as CMake cache entries, to be used as `cmake -C tuned.cmake ...`.
+# Entries already in the output file for parameters not tuned in this run are kept, so several queues
+# can be tuned into one file.
+
+set -eu
+
+usage() {
+    cat >&2 <<EOF
+Usage: $0 [options] [-- queueBench options]
+  -q QUEUE   queue to tune: BLQueue (BUFFER_SIZE, RETIRED_THRESHOLD), LLQueue (RETIRED_THRESHOLD)
+             or RingsQueue (RING_SIZE) (default: BLQueue)
+  -b VALUES  comma-separated BUFFER_SIZE values (default: 64,256,1024,4096)
+  -r VALUES  comma-separated RING_SIZE values (default: 64,256,1024,4096)
+  -T VALUES  comma-separated RETIRED_THRESHOLD values (default: 32,128,512,2048)
+  -m METRIC  throughput (mean ops/s over all runs) or p99 (mean of the worse of push/pop p99)
+             (default: throughput)
+  -d DIR     directory for the builds and results (default: _autotune)
+  -o FILE    CMake cache file to write (default: tuned.cmake)
+The queueBench options after -- describe the workload (default: -t 1,2,4 -n 1000000 -R 3).
+EOF
+}
+
+src=$(cd "$(dirname "$0")" && pwd)
+queue=BLQueue
+buffer_sizes=64,256,1024,4096
+ring_sizes=64,256,1024,4096
+thresholds=32,128,512,2048
+metric=throughput
+dir=_autotune
+output=tuned.cmake
+
+while getopts "q:b:r:T:m:d:o:h" opt; do
+    case $opt in
+        q) queue=$OPTARG ;;
+        b) buffer_sizes=$OPTARG ;;
+        r) ring_sizes=$OPTARG ;;
+        T) thresholds=$OPTARG ;;
+        m) metric=$OPTARG ;;
+        d) dir=$OPTARG ;;
+        o) output=$OPTARG ;;
+        h) usage; exit 0 ;;
+        *) usage; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+[ "${1:-}" = "--" ] && shift
+[ $# -gt 0 ] || set -- -t 1,2,4 -n 1000000 -R 3
+
+# Parameters that affect the queue; the others are left at their defaults.
+case $queue in
+    BLQueue) params="BUFFER_SIZE RETIRED_THRESHOLD" ;;
+    LLQueue) params="RETIRED_THRESHOLD" ;;
+    RingsQueue) params="RING_SIZE" ;;
+    *) echo "Nothing to tune for queue: $queue" >&2; exit 1 ;;
+esac
+case $metric in
+    throughput|p99) ;;
+    *) usage; exit 1 ;;
+esac
+
+values() {
+    case $1 in
+        BUFFER_SIZE) echo "$buffer_sizes" | tr ',' ' ' ;;
+        RING_SIZE) echo "$ring_sizes" | tr ',' ' ' ;;
+        RETIRED_THRESHOLD) echo "$thresholds" | tr ',' ' ' ;;
+    esac
+}
+
+# Every point of the grid as "PARAM=value PARAM=value".
+points=""
+for p in $params; do
+    next=""
+    for v in $(values "$p"); do
+        if [ -z "$points" ]; then
+            next="$next $p=$v"
+        else
+            for point in $points; do next="$next $point,$p=$v"; done
+        fi
+    done
+    points=$next
+done
+
+# Scores a run; higher is better, so p99 scores are negated latencies in ns.
+score() {
+    if [ "$metric" = throughput ]; then
+        awk -F, 'NR > 1 && $9 == "all" { sum += $14; n++ } END { if (n) printf "%.0f\n", sum / n }' "$1"
+    else
+        awk -F, 'NR > 1 && ($9 == "push" || $9 == "pop") {
+                     key = $3 "," $8
+                     if (!(key in worst) || $13 > worst[key]) worst[key] = $13
+                 }
+                 END { for (k in worst) { sum += worst[k]; n++ } if (n) printf "%.1f\n", -sum / n }' "$1"
+    fi
+}
+
+mkdir -p "$dir"
+results="$dir/$queue.csv"
+echo "point,score" > "$results"
+best_point=""
+best_score=""
+for point in $points; do
+    name=$(echo "$point" | tr ',=' '__')
+    build="$dir/$name"
+    defs=""
+    for kv in $(echo "$point" | tr ',' ' '); do defs="$defs -DQUEUE_$kv"; done
+
+    echo "== $queue $point" >&2
+    # shellcheck disable=SC2086
+    cmake -S "$src" -B "$build" $defs -DCMAKE_VERBOSE_MAKEFILE=OFF > "$build.log" 2>&1
+    cmake --build "$build" --target queueBench -j"$(nproc)" >> "$build.log" 2>&1
+
+    # queueBench fails when a run lost or duplicated items; such a point is never picked.
+    if [ "$metric" = throughput ]; then flag=-o; else flag=-O; fi
+    if ! "$build/queueBench" -q "$queue" $flag "$build.csv" "$@" >> "$build.log" 2>&1; then
+        echo "   failed, see $build.log" >&2
+        echo "$(echo "$point" | tr ',' ' ')," >> "$results"
+        continue
+    fi
+    s=$(score "$build.csv")
+    echo "   score $s" >&2
+    echo "$(echo "$point" | tr ',' ' '),$s" >> "$results"
+    if [ -n "$s" ] && { [ -z "$best_score" ] || awk -v a="$s" -v b="$best_score" 'BEGIN { exit !(a > b) }'; }; then
+        best_point=$point
+        best_score=$s
+    fi
+done
+
+if [ -z "$best_point" ]; then
+    echo "No run produced a score, see the logs in $dir" >&2
+    exit 1
+fi
+
+# Keep entries for parameters this run did not tune.
+tmp="$output.tmp"
+: > "$tmp"
+if [ -f "$output" ]; then
+    pattern=$(for p in $params; do printf 'QUEUE_%s|' "$p"; done)
+    pattern=${pattern%|}
+    grep -Ev "^set\(($pattern) " "$output" >> "$tmp" || true
+fi
+for kv in $(echo "$best_point" | tr ',' ' '); do
+    echo "set(QUEUE_${kv%%=*} ${kv#*=} CACHE STRING \"autotune.sh: $queue, $metric $best_score\")" >> "$tmp"
+done
+mv "$tmp" "$output"
+
+echo "Best for $queue ($metric): $best_point (score $best_score), written to $output; all scores in $results"
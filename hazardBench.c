@@ -0,0 +1,373 @@
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "HazardPointer.h"
+#include "Timing.h"
+
+//Microbenchmarks of the reclamation layer on its own, without any queue logic around it:
+//  protect - HazardPointer_protect + HazardPointer_clear round-trips on a shared pointer,
+//  retire  - HazardPointer_retire throughput (including the scans and frees it triggers),
+//  scan    - latency of a single scan with a given number of live hazards.
+
+#define CACHE_LINE 64
+#define MAX_LIST 32
+
+typedef struct HazardBenchConfig {
+    bool protect;
+    bool retire;
+    bool scan;
+    int thread_counts[MAX_LIST];
+    int num_thread_counts;
+    int thresholds[MAX_LIST];
+    int num_thresholds;
+    int hazard_counts[MAX_LIST];
+    int num_hazard_counts;
+    long iterations;    //Operations per thread.
+    size_t object_size; //Size of retired objects.
+    bool writer;        //Keep changing the protected pointer from an extra thread.
+    bool handles;       //Call the HazardPointer_*_with variants through a per-thread handle.
+    bool acquire;       //Threads take ids with HazardPointer_acquire instead of registering.
+    const char* label;
+} HazardBenchConfig;
+
+typedef enum { BENCH_PROTECT, BENCH_RETIRE } HazardBenchKind;
+
+static const char* bench_names[] = { "protect", "retire" };
+
+struct HazardRun;
+
+typedef struct HazardThread {
+    _Alignas(CACHE_LINE) pthread_t handle;
+    struct HazardRun* run;
+    int id;
+    uint64_t start_ns;
+    uint64_t end_ns;
+} HazardThread;
+
+typedef struct HazardRun {
+    const HazardBenchConfig* cfg;
+    HazardPointer* hp;
+    int num_threads;
+    HazardBenchKind kind;
+    pthread_barrier_t barrier;
+    _Alignas(CACHE_LINE) _Atomic(void*) target; //Pointer protected by the protect benchmark.
+    _Alignas(CACHE_LINE) _Atomic bool stop;     //Stops the writer thread.
+    HazardThread threads[]; //num_threads of them.
+} HazardRun;
+
+static char dummies[2]; //Alternately protected by the protect benchmark.
+
+static void* thread_main(void* arg) {
+    HazardThread* self = arg;
+    HazardRun* run = self->run;
+    if (run->cfg->acquire) HazardPointer_acquire();
+    else HazardPointer_register(self->id, run->num_threads);
+    HazardPointer_Handle handle;
+    HazardPointer_handle(run->hp, &handle);
+
+    void** objects = NULL;
+    if (run->kind == BENCH_RETIRE) {
+        //Allocate up front so that only retire (and the frees its scans do) is timed.
+        objects = malloc(run->cfg->iterations * sizeof(void*));
+        assert(objects);
+        for (long i = 0; i < run->cfg->iterations; i++) {
+            objects[i] = malloc(run->cfg->object_size);
+            assert(objects[i]);
+        }
+    }
+
+    pthread_barrier_wait(&run->barrier);
+    self->start_ns = Timing_now_ns();
+    if (run->kind == BENCH_RETIRE && run->cfg->handles) {
+        for (long i = 0; i < run->cfg->iterations; i++) HazardPointer_retire_with(&handle, objects[i], 0);
+    }
+    else if (run->kind == BENCH_RETIRE) {
+        for (long i = 0; i < run->cfg->iterations; i++) HazardPointer_retire(run->hp, objects[i]);
+    }
+    else if (run->cfg->handles) {
+        for (long i = 0; i < run->cfg->iterations; i++) {
+            void* p = HazardPointer_protect_with(&handle, 0, &run->target);
+            __asm__ volatile("" : : "r"(p) : "memory"); //Keep the result live.
+            HazardPointer_clear_with(&handle, 0);
+        }
+    }
+    else {
+        for (long i = 0; i < run->cfg->iterations; i++) {
+            void* p = HazardPointer_protect(run->hp, &run->target);
+            __asm__ volatile("" : : "r"(p) : "memory"); //Keep the result live.
+            HazardPointer_clear(run->hp);
+        }
+    }
+    self->end_ns = Timing_now_ns();
+    if (run->cfg->acquire) HazardPointer_release();
+
+    free(objects);
+    return NULL;
+}
+
+static void* writer_main(void* arg) {
+    HazardRun* run = arg;
+    for (int i = 0; !atomic_load_explicit(&run->stop, memory_order_relaxed); i ^= 1) {
+        atomic_store(&run->target, &dummies[i]);
+    }
+    return NULL;
+}
+
+//threshold is the one requested; the one printed is the largest that triggered a scan, which is larger
+//when the hazards of the registered threads outnumber half of it (0 if nothing was retired).
+static void print_result(FILE* csv, const HazardBenchConfig* cfg, const char* bench, int threads, int threshold,
+                         int hazards, long ops, double secs, const HazardPointer_Stats* stats) {
+    double ns_per_op = ops > 0 ? secs * 1e9 / ops * threads : 0.0;
+    double ticks_per_ns = Timing_cycles_per_ns();
+    const HazardPointer_ThreadStats* t = &stats->total;
+    double avg_scan_ns = t->scans > 0 ? t->scan_cycles / ticks_per_ns / t->scans : 0.0;
+    double max_scan_ns = t->max_scan_cycles / ticks_per_ns;
+
+    printf("%-8s threads=%3d threshold=%5lu (requested %5d) hazards=%3d  %12.0f ops/s  %8.1f ns/op/thread  scans=%lu avg scan=%.0fns max scan=%.0fns\n",
+           bench, threads, (unsigned long)t->scan_threshold, threshold, hazards, secs > 0 ? ops / secs : 0.0, ns_per_op,
+           (unsigned long)t->scans, avg_scan_ns, max_scan_ns);
+    if (csv) {
+        fprintf(csv, "%s,%s,%d,%lu,%d,%ld,%.6f,%.2f,%lu,%.1f,%.1f,%d\n", cfg->label, bench, threads,
+                (unsigned long)t->scan_threshold, hazards, ops, secs, ns_per_op, (unsigned long)t->scans,
+                avg_scan_ns, max_scan_ns, threshold);
+    }
+}
+
+//Runs the benchmark on num_threads threads sharing one HazardPointer and reports aggregate throughput.
+static void run_threads(const HazardBenchConfig* cfg, HazardBenchKind kind, int num_threads, int threshold, FILE* csv) {
+    size_t size = sizeof(HazardRun) + num_threads * sizeof(HazardThread);
+    size = (size + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    HazardRun* run = aligned_alloc(CACHE_LINE, size);
+    assert(run);
+    memset(run, 0, size);
+    run->cfg = cfg;
+    run->num_threads = num_threads;
+    run->kind = kind;
+    atomic_init(&run->target, &dummies[0]);
+    atomic_init(&run->stop, false);
+
+    run->hp = aligned_alloc(_Alignof(HazardPointer), sizeof(HazardPointer));
+    assert(run->hp);
+    HazardPointer_initialize(run->hp);
+    HazardPointer_set_retired_threshold(run->hp, threshold);
+    HazardPointer_set_node_size(run->hp, cfg->object_size);
+
+    pthread_t writer;
+    bool with_writer = cfg->writer && kind == BENCH_PROTECT;
+    if (with_writer) pthread_create(&writer, NULL, writer_main, run);
+
+    pthread_barrier_init(&run->barrier, NULL, num_threads);
+    for (int i = 0; i < num_threads; i++) {
+        run->threads[i].run = run;
+        run->threads[i].id = i;
+        int err = pthread_create(&run->threads[i].handle, NULL, thread_main, &run->threads[i]);
+        if (err != 0) {
+            fprintf(stderr, "pthread_create: %s\n", strerror(err));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    uint64_t start = UINT64_MAX, end = 0;
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(run->threads[i].handle, NULL);
+        if (run->threads[i].start_ns < start) start = run->threads[i].start_ns;
+        if (run->threads[i].end_ns > end) end = run->threads[i].end_ns;
+    }
+    pthread_barrier_destroy(&run->barrier);
+    if (with_writer) {
+        atomic_store(&run->stop, true);
+        pthread_join(writer, NULL);
+    }
+
+    HazardPointer_Stats* stats = malloc(sizeof(HazardPointer_Stats));
+    assert(stats);
+    HazardPointer_stats(run->hp, stats);
+    print_result(csv, cfg, bench_names[kind], num_threads, threshold, 0, cfg->iterations * num_threads, (end - start) / 1e9, stats);
+    free(stats);
+
+    HazardPointer_finalize(run->hp);
+    free(run->hp);
+    free(run);
+}
+
+//Single-threaded: `hazards` other threads hold live (never retired) hazards while this thread
+//retires objects; the scans it triggers are timed by the HazardPointer telemetry.
+static void run_scan(const HazardBenchConfig* cfg, int hazards, int threshold, FILE* csv) {
+    HazardPointer* hp = aligned_alloc(_Alignof(HazardPointer), sizeof(HazardPointer));
+    assert(hp);
+    HazardPointer_initialize(hp);
+    HazardPointer_set_retired_threshold(hp, threshold);
+    HazardPointer_set_node_size(hp, cfg->object_size);
+
+    int num_threads = hazards + 1;
+    _Atomic(void*)* atoms = malloc(num_threads * sizeof(_Atomic(void*)));
+    char* protected = malloc(num_threads);
+    assert(atoms && protected);
+    for (int i = 1; i < num_threads; i++) {
+        //Acting as thread i, leave a hazard on a dummy object behind.
+        atomic_init(&atoms[i], &protected[i]);
+        HazardPointer_register(i, num_threads);
+        HazardPointer_protect(hp, &atoms[i]);
+    }
+    HazardPointer_register(0, num_threads);
+
+    long n = cfg->iterations;
+    void** objects = malloc(n * sizeof(void*));
+    assert(objects);
+    for (long i = 0; i < n; i++) {
+        objects[i] = malloc(cfg->object_size);
+        assert(objects[i]);
+    }
+
+    uint64_t start = Timing_now_ns();
+    for (long i = 0; i < n; i++) HazardPointer_retire(hp, objects[i]);
+    uint64_t end = Timing_now_ns();
+
+    HazardPointer_Stats* stats = malloc(sizeof(HazardPointer_Stats));
+    assert(stats);
+    HazardPointer_stats(hp, stats);
+    print_result(csv, cfg, "scan", 1, threshold, hazards, n, (end - start) / 1e9, stats);
+    free(stats);
+
+    free(objects);
+    HazardPointer_finalize(hp);
+    free(hp);
+    free(atoms);
+    free(protected);
+}
+
+static int parse_int_list(char* arg, int* out, int max) {
+    int n = 0;
+    for (char* tok = strtok(arg, ","); tok && n < max; tok = strtok(NULL, ",")) out[n++] = atoi(tok);
+    return n;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -b BENCHES  comma-separated subset of protect,retire,scan (default: all)\n"
+            "  -t COUNTS   comma-separated thread counts for protect/retire, each <= %d (default: 1,2,4)\n"
+            "  -T LIST     comma-separated retired thresholds for retire/scan (default: %d)\n"
+            "  -H LIST     comma-separated numbers of live hazards for scan, each < %d (default: 0,8,32,127)\n"
+            "  -n ITERS    operations per thread (default: 1000000)\n"
+            "  -s BYTES    size of retired objects (default: 16)\n"
+            "  -w          change the protected pointer continuously from an extra thread\n"
+            "  -k          protect/retire through per-thread handles (HazardPointer_*_with)\n"
+            "  -a          threads acquire ids (HazardPointer_acquire/release) instead of registering\n"
+            "  -o FILE     write results as CSV\n"
+            "  -l LABEL    label stored in the CSV (default: default)\n",
+            prog, HAZARD_MAX_THREADS, RETIRED_THRESHOLD, HAZARD_MAX_THREADS);
+}
+
+int main(int argc, char** argv) {
+    HazardBenchConfig cfg = {
+        .protect = false,
+        .retire = false,
+        .scan = false,
+        .thread_counts = { 1, 2, 4 },
+        .num_thread_counts = 3,
+        .thresholds = { RETIRED_THRESHOLD },
+        .num_thresholds = 1,
+        .hazard_counts = { 0, 8, 32, MAX_THREADS - 1 },
+        .num_hazard_counts = 4,
+        .iterations = 1000000,
+        .object_size = 16,
+        .writer = false,
+        .handles = false,
+        .acquire = false,
+        .label = "default",
+    };
+    const char* output = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "b:t:T:H:n:s:wkao:l:h")) != -1) {
+        switch (opt) {
+            case 'b':
+                for (char* tok = strtok(optarg, ","); tok; tok = strtok(NULL, ",")) {
+                    if (strcmp(tok, "protect") == 0) cfg.protect = true;
+                    else if (strcmp(tok, "retire") == 0) cfg.retire = true;
+                    else if (strcmp(tok, "scan") == 0) cfg.scan = true;
+                    else {
+                        fprintf(stderr, "Unknown benchmark: %s\n", tok);
+                        return EXIT_FAILURE;
+                    }
+                }
+                break;
+            case 't': cfg.num_thread_counts = parse_int_list(optarg, cfg.thread_counts, MAX_LIST); break;
+            case 'T': cfg.num_thresholds = parse_int_list(optarg, cfg.thresholds, MAX_LIST); break;
+            case 'H': cfg.num_hazard_counts = parse_int_list(optarg, cfg.hazard_counts, MAX_LIST); break;
+            case 'n': cfg.iterations = atol(optarg); break;
+            case 's': cfg.object_size = (size_t)atol(optarg); break;
+            case 'w': cfg.writer = true; break;
+            case 'k': cfg.handles = true; break;
+            case 'a': cfg.acquire = true; break;
+            case 'o': output = optarg; break;
+            case 'l': cfg.label = optarg; break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (!cfg.protect && !cfg.retire && !cfg.scan) cfg.protect = cfg.retire = cfg.scan = true;
+
+    for (int i = 0; i < cfg.num_thread_counts; i++) {
+        if (cfg.thread_counts[i] < 1 || cfg.thread_counts[i] > HAZARD_MAX_THREADS) {
+            fprintf(stderr, "Thread count must be in [1, %d]\n", HAZARD_MAX_THREADS);
+            return EXIT_FAILURE;
+        }
+    }
+    for (int i = 0; i < cfg.num_hazard_counts; i++) {
+        if (cfg.hazard_counts[i] < 0 || cfg.hazard_counts[i] >= HAZARD_MAX_THREADS) {
+            fprintf(stderr, "Number of live hazards must be in [0, %d)\n", HAZARD_MAX_THREADS);
+            return EXIT_FAILURE;
+        }
+    }
+    for (int i = 0; i < cfg.num_thresholds; i++) {
+        if (cfg.thresholds[i] < 1) {
+            fprintf(stderr, "Retired threshold must be positive\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    FILE* csv = NULL;
+    if (output) {
+        csv = fopen(output, "w");
+        if (!csv) {
+            fprintf(stderr, "%s: %s\n", output, strerror(errno));
+            return EXIT_FAILURE;
+        }
+        fprintf(csv, "label,bench,threads,threshold,hazards,ops,seconds,ns_per_op,scans,avg_scan_ns,max_scan_ns,requested_threshold\n");
+    }
+
+    if (HazardPointer_asymmetric_fences()) printf("Hazard protection: plain stores, scans fence with membarrier\n");
+    if (cfg.protect) {
+        for (int t = 0; t < cfg.num_thread_counts; t++) {
+            run_threads(&cfg, BENCH_PROTECT, cfg.thread_counts[t], RETIRED_THRESHOLD, csv);
+        }
+    }
+    if (cfg.retire) {
+        for (int k = 0; k < cfg.num_thresholds; k++) {
+            for (int t = 0; t < cfg.num_thread_counts; t++) {
+                run_threads(&cfg, BENCH_RETIRE, cfg.thread_counts[t], cfg.thresholds[k], csv);
+            }
+        }
+    }
+    if (cfg.scan) {
+        for (int k = 0; k < cfg.num_thresholds; k++) {
+            for (int h = 0; h < cfg.num_hazard_counts; h++) run_scan(&cfg, cfg.hazard_counts[h], cfg.thresholds[k], csv);
+        }
+    }
+
+    if (csv) fclose(csv);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,333 @@
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "HazardPointer.h"
+#include "Histogram.h"
+#include "QueueVTable.h"
+#include "Timing.h"
+
+//Runs items through a pipeline of thread stages connected by queues, e.g. 4:LLQueue:2:BLQueue:1 is
+//4 source threads pushing into an LLQueue, 2 workers moving items from it into a BLQueue and
+//1 sink popping from that. Each queue may be of any type from queueVTables. Every stage spends a
+//synthetic work cost per item; items carry their creation timestamp, so the sinks measure
+//end-to-end latency including time spent waiting in the queues.
+
+#define CACHE_LINE 64
+#define MAX_STAGES 5
+
+struct PipelineRun;
+
+typedef struct PipelineThread {
+    _Alignas(CACHE_LINE) pthread_t handle;
+    struct PipelineRun* run;
+    int id;    //HazardPointer thread id, unique over all stages.
+    int stage;
+    long items; //Items to create, for source threads.
+    long moved; //Items pushed downstream, or consumed by a sink.
+    long empty_pops;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    Histogram* latency; //End-to-end, in Timing_cycles ticks; sinks only.
+} PipelineThread;
+
+typedef struct PipelineLink {
+    const QueueVTable* Q;
+    void* queue;
+    _Alignas(CACHE_LINE) _Atomic int upstream_done; //Threads of the stage before that have finished.
+} PipelineLink;
+
+typedef struct PipelineConfig {
+    int num_stages;
+    int threads[MAX_STAGES];
+    const QueueVTable* queues[MAX_STAGES - 1]; //queues[i] connects stage i to stage i + 1.
+    long work_ns[MAX_STAGES];
+    long items;
+    bool poll_empty; //Downstream stages call is_empty before every pop.
+    int repeats;
+    const char* label;
+} PipelineConfig;
+
+typedef struct PipelineRun {
+    const PipelineConfig* cfg;
+    PipelineLink links[MAX_STAGES - 1];
+    uint64_t origin;        //Timing_cycles at setup; items hold their creation time relative to it.
+    uint64_t work_ticks[MAX_STAGES];
+    int num_threads;
+    pthread_barrier_t barrier;
+    PipelineThread* threads;
+} PipelineRun;
+
+static void spin_ticks(uint64_t ticks) {
+    if (ticks == 0) return;
+    uint64_t until = Timing_cycles() + ticks;
+    while (Timing_cycles() < until) {
+#if defined(__x86_64__) || defined(__i386__)
+        _mm_pause();
+#endif
+    }
+}
+
+//An item is its creation time, which is positive and never EMPTY_VALUE or TAKEN_VALUE.
+static inline Value make_item(const PipelineRun* run) {
+    return (Value)(Timing_cycles() - run->origin + 1);
+}
+
+//Pops one item, first polling is_empty if so configured.
+static inline Value take(const PipelineRun* run, PipelineLink* in) {
+    if (run->cfg->poll_empty && in->Q->is_empty(in->queue)) return EMPTY_VALUE;
+    return in->Q->pop(in->queue);
+}
+
+static void* pipeline_thread(void* arg) {
+    PipelineThread* self = arg;
+    PipelineRun* run = self->run;
+    const PipelineConfig* cfg = run->cfg;
+    PipelineLink* in = self->stage > 0 ? &run->links[self->stage - 1] : NULL;
+    PipelineLink* out = self->stage < cfg->num_stages - 1 ? &run->links[self->stage] : NULL;
+    int upstream = self->stage > 0 ? cfg->threads[self->stage - 1] : 0;
+    uint64_t work = run->work_ticks[self->stage];
+    HazardPointer_register(self->id, run->num_threads);
+
+    pthread_barrier_wait(&run->barrier);
+    self->start_ns = Timing_now_ns();
+    if (!in) {
+        for (long i = 0; i < self->items; i++) {
+            spin_ticks(work);
+            out->Q->push(out->queue, make_item(run));
+        }
+        self->moved = self->items;
+    }
+    else {
+        for (;;) {
+            //Read before the pop: an empty pop after the upstream stage finished means the queue stays empty.
+            bool done = atomic_load_explicit(&in->upstream_done, memory_order_acquire) == upstream;
+            Value item = take(run, in);
+            if (item == EMPTY_VALUE) {
+                if (done) break;
+                self->empty_pops++;
+                continue;
+            }
+            spin_ticks(work);
+            if (out) out->Q->push(out->queue, item);
+            else Histogram_record(self->latency, Timing_cycles() - run->origin + 1 - (uint64_t)item);
+            self->moved++;
+        }
+    }
+    self->end_ns = Timing_now_ns();
+    if (out) atomic_fetch_add_explicit(&out->upstream_done, 1, memory_order_release);
+    return NULL;
+}
+
+//Writes the topology in -s syntax and the per-stage work costs separated by '/'.
+static void describe(const PipelineConfig* cfg, char* topology, char* work, size_t size) {
+    size_t len = 0, wlen = 0;
+    for (int s = 0; s < cfg->num_stages && len < size && wlen < size; s++) {
+        len += snprintf(topology + len, size - len, "%d", cfg->threads[s]);
+        if (s < cfg->num_stages - 1 && len < size) len += snprintf(topology + len, size - len, ":%s:", cfg->queues[s]->name);
+        wlen += snprintf(work + wlen, size - wlen, s > 0 ? "/%ld" : "%ld", cfg->work_ns[s]);
+    }
+}
+
+//Returns false if not every item reached the sinks.
+static bool pipeline_once(const PipelineConfig* cfg, int rep, FILE* csv) {
+    PipelineRun run = { .cfg = cfg };
+    double ticks_per_ns = Timing_cycles_per_ns();
+    for (int s = 0; s < cfg->num_stages; s++) {
+        run.num_threads += cfg->threads[s];
+        run.work_ticks[s] = (uint64_t)(cfg->work_ns[s] * ticks_per_ns);
+    }
+    for (int s = 0; s < cfg->num_stages - 1; s++) {
+        run.links[s].Q = cfg->queues[s];
+        run.links[s].queue = cfg->queues[s]->new();
+        atomic_init(&run.links[s].upstream_done, 0);
+    }
+
+    run.threads = aligned_alloc(CACHE_LINE, run.num_threads * sizeof(PipelineThread));
+    assert(run.threads);
+    memset(run.threads, 0, run.num_threads * sizeof(PipelineThread));
+    int id = 0;
+    for (int s = 0; s < cfg->num_stages; s++) {
+        for (int i = 0; i < cfg->threads[s]; i++, id++) {
+            PipelineThread* t = &run.threads[id];
+            t->run = &run;
+            t->id = id;
+            t->stage = s;
+            if (s == 0) t->items = cfg->items / cfg->threads[0] + (i < cfg->items % cfg->threads[0]);
+            if (s == cfg->num_stages - 1) {
+                t->latency = malloc(sizeof(Histogram));
+                assert(t->latency);
+                Histogram_init(t->latency);
+            }
+        }
+    }
+
+    run.origin = Timing_cycles();
+    pthread_barrier_init(&run.barrier, NULL, run.num_threads);
+    for (int i = 0; i < run.num_threads; i++) {
+        int err = pthread_create(&run.threads[i].handle, NULL, pipeline_thread, &run.threads[i]);
+        if (err != 0) {
+            fprintf(stderr, "pthread_create: %s\n", strerror(err));
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    uint64_t start = UINT64_MAX, end = 0;
+    for (int i = 0; i < run.num_threads; i++) {
+        pthread_join(run.threads[i].handle, NULL);
+        if (run.threads[i].start_ns < start) start = run.threads[i].start_ns;
+        if (run.threads[i].end_ns > end) end = run.threads[i].end_ns;
+    }
+    pthread_barrier_destroy(&run.barrier);
+
+    long stage_moved[MAX_STAGES] = { 0 }, stage_empty[MAX_STAGES] = { 0 };
+    Histogram* latency = malloc(sizeof(Histogram));
+    assert(latency);
+    Histogram_init(latency);
+    for (int i = 0; i < run.num_threads; i++) {
+        PipelineThread* t = &run.threads[i];
+        stage_moved[t->stage] += t->moved;
+        stage_empty[t->stage] += t->empty_pops;
+        if (t->latency) {
+            Histogram_merge(latency, t->latency);
+            free(t->latency);
+        }
+    }
+
+    char topology[256], work[256];
+    describe(cfg, topology, work, sizeof(topology));
+    long delivered = stage_moved[cfg->num_stages - 1];
+    double secs = (end - start) / 1e9;
+    double p50 = Histogram_percentile(latency, 0.5) / ticks_per_ns, p99 = Histogram_percentile(latency, 0.99) / ticks_per_ns;
+    double p999 = Histogram_percentile(latency, 0.999) / ticks_per_ns, max = latency->max / ticks_per_ns;
+    printf("%s run=%d  %ld items  %.3fs  %12.0f items/s  end-to-end p50=%.0fns p99=%.0fns p999=%.0fns max=%.0fns\n",
+           topology, rep, delivered, secs, secs > 0 ? delivered / secs : 0.0, p50, p99, p999, max);
+    printf("    empty pops per stage:");
+    for (int s = 1; s < cfg->num_stages; s++) printf(" %ld", stage_empty[s]);
+    printf("\n");
+    bool valid = delivered == cfg->items;
+    if (!valid) fprintf(stderr, "%s: created %ld items but %ld reached the sinks\n", topology, cfg->items, delivered);
+
+    if (csv) {
+        fprintf(csv, "%s,%s,%d,%d,%s,%ld,%.6f,%.0f,%.1f,%.1f,%.1f,%.1f\n", cfg->label, topology, rep, cfg->poll_empty,
+                work, delivered, secs, secs > 0 ? delivered / secs : 0.0, p50, p99, p999, max);
+    }
+
+    free(latency);
+    HazardPointer_register(0, run.num_threads);
+    for (int s = 0; s < cfg->num_stages - 1; s++) cfg->queues[s]->delete(run.links[s].queue);
+    free(run.threads);
+    return valid;
+}
+
+//Parses THREADS:QUEUE:THREADS[:QUEUE:THREADS...]. Returns false on a malformed or oversized topology.
+static bool parse_topology(char* spec, PipelineConfig* cfg) {
+    cfg->num_stages = 0;
+    int total = 0;
+    int field = 0;
+    for (char* tok = strtok(spec, ":"); tok; tok = strtok(NULL, ":"), field++) {
+        if (field % 2 == 0) {
+            if (cfg->num_stages == MAX_STAGES) return false;
+            int n = atoi(tok);
+            if (n < 1 || n > HAZARD_MAX_THREADS) return false;
+            cfg->threads[cfg->num_stages++] = n;
+            total += n;
+        }
+        else {
+            const QueueVTable* Q = QueueVTable_find(tok);
+            if (!Q) {
+                fprintf(stderr, "Unknown queue: %s\n", tok);
+                return false;
+            }
+            cfg->queues[cfg->num_stages - 1] = Q;
+        }
+    }
+    return field % 2 == 1 && cfg->num_stages >= 2 && total <= HAZARD_MAX_THREADS;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -s TOPO    stages and the queues between them, THREADS:QUEUE:THREADS[:QUEUE:THREADS...],\n"
+            "             2 to %d stages and at most %d threads in total (default: 2:LLQueue:2:BLQueue:1)\n"
+            "  -w NS      synthetic work per item in each stage, one value or a comma-separated list per stage (default: 0)\n"
+            "  -n ITEMS   items sent through the pipeline (default: 1000000)\n"
+            "  -e         stages poll is_empty before every pop\n"
+            "  -R REPEATS repetitions (default: 1)\n"
+            "  -o FILE    write results as CSV\n"
+            "  -l LABEL   label stored in the CSV (default: default)\n",
+            prog, MAX_STAGES, HAZARD_MAX_THREADS);
+}
+
+int main(int argc, char** argv) {
+    PipelineConfig cfg = {
+        .work_ns = { 0 },
+        .items = 1000000,
+        .poll_empty = false,
+        .repeats = 1,
+        .label = "default",
+    };
+    char default_topology[] = "2:LLQueue:2:BLQueue:1";
+    char* topology = default_topology;
+    long work[MAX_STAGES];
+    int num_work = 0;
+    const char* output = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:w:n:eR:o:l:h")) != -1) {
+        switch (opt) {
+            case 's': topology = optarg; break;
+            case 'w':
+                num_work = 0;
+                for (char* tok = strtok(optarg, ","); tok && num_work < MAX_STAGES; tok = strtok(NULL, ",")) {
+                    work[num_work++] = atol(tok);
+                }
+                break;
+            case 'n': cfg.items = atol(optarg); break;
+            case 'e': cfg.poll_empty = true; break;
+            case 'R': cfg.repeats = atoi(optarg); break;
+            case 'o': output = optarg; break;
+            case 'l': cfg.label = optarg; break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (!parse_topology(topology, &cfg) || cfg.items < 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    for (int s = 0; s < cfg.num_stages; s++) {
+        cfg.work_ns[s] = num_work == 0 ? 0 : work[s < num_work ? s : num_work - 1];
+    }
+
+    FILE* csv = NULL;
+    if (output) {
+        csv = fopen(output, "w");
+        if (!csv) {
+            fprintf(stderr, "%s: %s\n", output, strerror(errno));
+            return EXIT_FAILURE;
+        }
+        fprintf(csv, "label,topology,run,poll_empty,work_ns,items,seconds,items_per_sec,p50_ns,p99_ns,p999_ns,max_ns\n");
+    }
+
+    printf("Work per item and stage (ns):");
+    for (int s = 0; s < cfg.num_stages; s++) printf(" %ld", cfg.work_ns[s]);
+    printf("\n");
+    bool valid = true;
+    for (int rep = 0; rep < cfg.repeats; rep++) {
+        if (!pipeline_once(&cfg, rep, csv)) valid = false;
+    }
+
+    if (csv) fclose(csv);
+    return valid ? EXIT_SUCCESS : EXIT_FAILURE;
+}
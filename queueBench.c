@@ -0,0 +1,897 @@
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "HazardPointer.h"
+#include "Histogram.h"
+#include "PerfCounters.h"
+#include "QueueBackoff.h"
+#include "QueueDelay.h"
+#include "QueueTrace.h"
+#include "QueueVTable.h"
+#include "Sojourn.h"
+#include "Timing.h"
+
+#define CACHE_LINE 64
+#define MAX_LIST 32
+
+typedef enum { ROLE_PRODUCER, ROLE_CONSUMER, ROLE_MIXED } Role;
+
+static const char* role_names[] = { "producer", "consumer", "mixed" };
+
+typedef enum { OP_PUSH, OP_POP, OP_IS_EMPTY, NUM_OPS } Op;
+
+static const char* op_names[] = { "push", "pop", "is_empty" };
+
+typedef struct BenchConfig {
+    const QueueVTable* queues[MAX_LIST];
+    int num_queues;
+    int schemes[RECLAIM_NUM_SCHEMES]; //Reclamation schemes to run queues with new_with_scheme under.
+    int num_schemes;                  //0 runs every queue with its default scheme.
+    int backoffs[QUEUE_BACKOFF_NUM_POLICIES]; //Backoff policies to run queues with set_backoff under.
+    int num_backoffs;                         //0 runs every queue with its default policy.
+    int thread_counts[MAX_LIST];
+    int num_thread_counts;
+    int ratio_push; //Producer share of threads, ignored in mixed mode.
+    int ratio_pop;  //Consumer share of threads, ignored in mixed mode.
+    bool mixed;     //Every thread alternates push and pop.
+    long items;     //Items pushed per run, split evenly between pushing threads.
+    long prefill;   //Items pushed before the measured phase starts.
+    bool pin;
+    bool poll_empty; //Consumers call is_empty before every pop and only pop a non-empty queue.
+    bool latency;    //Time every operation into per-thread histograms.
+    bool perf;       //Count hardware events per thread with perf_event_open.
+    bool sojourn;    //Push timestamps through a SojournQueue and report time spent in the queue.
+    bool handles;    //LLQueue/BLQueue threads operate through their own HazardPointer_Handle (*_with calls).
+    bool footprint;  //Measure memory instead of throughput.
+    long reclaimer_us; //LLQueue/BLQueue reclaim on a background thread scanning this often; 0 for inline scans.
+    size_t reclaimer_watermark;
+    bool shared_domain; //Footprint mode: LLQueue/BLQueue instances share one HazardPointer.
+    QueueDelayMode delay_mode; //Delays injected at the queues' delay points (needs QUEUE_DELAY_INJECTION).
+    double delay_probability;
+    long delay_ns;
+    long depths[MAX_LIST];
+    int num_depths;
+    long instance_counts[MAX_LIST];
+    int num_instance_counts;
+    int repeats;
+    const char* output;
+    const char* latency_output;
+    const char* trace_output; //Chrome trace of the queues' events (needs QUEUE_TRACE).
+    const char* label;
+} BenchConfig;
+
+struct BenchRun;
+
+//Per-thread results, each on its own cache line so that counters do not false-share.
+typedef struct BenchThread {
+    _Alignas(CACHE_LINE) pthread_t handle;
+    struct BenchRun* run;
+    int id;
+    Role role;
+    long ops;        //Completed pushes plus pops that returned a value.
+    long empty_pops; //Pops that returned EMPTY_VALUE.
+    uint64_t start_ns;
+    uint64_t end_ns;
+    Histogram* latency; //NUM_OPS histograms in Timing_cycles ticks, NULL unless cfg->latency.
+    Histogram* sojourn; //SOJOURN_DEPTH_CLASSES histograms in Timing_cycles ticks, NULL unless cfg->sojourn.
+    bool perf_ok;       //perf counters were opened for this thread.
+    PerfCounters perf;
+    HazardPointer_Handle hp_handle; //This thread's handle for the queue if run->handles.
+} BenchThread;
+
+typedef struct BenchRun {
+    const BenchConfig* cfg;
+    const QueueVTable* Q;
+    char name[48];  //Queue name, followed by "/<scheme>" and "+<backoff>" if they were chosen.
+    bool qsbr;      //Threads announce quiescent states between operations.
+    bool handles;   //Threads call the queue's *_with operations with their hp_handle.
+    void* queue;
+    SojournQueue sojourn; //Wraps queue if cfg->sojourn.
+    int num_threads;
+    int producers;
+    int consumers;
+    long items_per_thread;
+    pthread_barrier_t barrier;
+    _Alignas(CACHE_LINE) _Atomic int producers_done;
+    BenchThread threads[]; //num_threads of them.
+} BenchRun;
+
+//Values are unique per producer and never equal to EMPTY_VALUE or TAKEN_VALUE.
+static inline Value make_value(int thread_id, long seq) {
+    return ((Value)(thread_id + 1) << 40) | (Value)(seq + 1);
+}
+
+//The calling benchmark thread's handle, or NULL to use the queue's plain operations.
+static inline HazardPointer_Handle* own_handle(BenchThread* self) {
+    return self->run->handles ? &self->hp_handle : NULL;
+}
+
+static inline void queue_push(BenchRun* run, HazardPointer_Handle* handle, Value value) {
+    if (run->cfg->sojourn) SojournQueue_push(&run->sojourn);
+    else if (handle) run->Q->push_with(run->queue, handle, value);
+    else run->Q->push(run->queue, value);
+    if (run->qsbr) HazardPointer_quiescent();
+}
+
+static inline Value queue_pop(BenchThread* self) {
+    BenchRun* run = self->run;
+    HazardPointer_Handle* handle = own_handle(self);
+    Value value;
+    if (run->cfg->sojourn) value = SojournQueue_pop(&run->sojourn, self->sojourn);
+    else if (handle) value = run->Q->pop_with(run->queue, handle);
+    else value = run->Q->pop(run->queue);
+    if (run->qsbr) HazardPointer_quiescent();
+    return value;
+}
+
+static inline bool queue_is_empty(BenchThread* self) {
+    BenchRun* run = self->run;
+    HazardPointer_Handle* handle = own_handle(self);
+    return handle ? run->Q->is_empty_with(run->queue, handle) : run->Q->is_empty(run->queue);
+}
+
+//Queue operations as seen by benchmark threads. In latency mode each call is bracketed by two
+//timestamps and recorded in the thread's own histogram; otherwise the check is one predictable branch.
+static inline void bench_push(BenchThread* self, Value value) {
+    BenchRun* run = self->run;
+    if (self->latency) {
+        uint64_t t0 = Timing_cycles();
+        queue_push(run, own_handle(self), value);
+        Histogram_record(&self->latency[OP_PUSH], Timing_cycles() - t0);
+    }
+    else queue_push(run, own_handle(self), value);
+}
+
+static inline Value bench_pop(BenchThread* self) {
+    if (self->latency) {
+        uint64_t t0 = Timing_cycles();
+        Value value = queue_pop(self);
+        Histogram_record(&self->latency[OP_POP], Timing_cycles() - t0);
+        return value;
+    }
+    return queue_pop(self);
+}
+
+static inline bool bench_is_empty(BenchThread* self) {
+    if (self->latency) {
+        uint64_t t0 = Timing_cycles();
+        bool empty = queue_is_empty(self);
+        Histogram_record(&self->latency[OP_IS_EMPTY], Timing_cycles() - t0);
+        return empty;
+    }
+    return queue_is_empty(self);
+}
+
+//Pops one value, first polling is_empty if so configured. Returns EMPTY_VALUE if nothing was taken.
+static inline Value bench_take(BenchThread* self) {
+    if (self->run->cfg->poll_empty && bench_is_empty(self)) return EMPTY_VALUE;
+    return bench_pop(self);
+}
+
+static void run_producer(BenchThread* self) {
+    BenchRun* run = self->run;
+    for (long i = 0; i < run->items_per_thread; i++) {
+        bench_push(self, make_value(self->id, i));
+    }
+    self->ops = run->items_per_thread;
+    atomic_fetch_add(&run->producers_done, 1);
+}
+
+//Pops until every producer has finished and the queue is drained.
+static void run_consumer(BenchThread* self) {
+    BenchRun* run = self->run;
+    long ops = 0, empty = 0;
+    for (;;) {
+        //Read before the pop: an empty pop after all producers finished means the queue stays empty.
+        bool done = atomic_load_explicit(&run->producers_done, memory_order_acquire) == run->producers;
+        if (bench_take(self) != EMPTY_VALUE) ops++;
+        else if (done) break;
+        else empty++;
+    }
+    self->ops = ops;
+    self->empty_pops = empty;
+}
+
+static void run_mixed(BenchThread* self) {
+    BenchRun* run = self->run;
+    long ops = 0, empty = 0;
+    for (long i = 0; i < run->items_per_thread; i++) {
+        bench_push(self, make_value(self->id, i));
+        ops++;
+        if (bench_take(self) != EMPTY_VALUE) ops++;
+        else empty++;
+    }
+    self->ops = ops;
+    self->empty_pops = empty;
+}
+
+static void* bench_thread(void* arg) {
+    BenchThread* self = arg;
+    HazardPointer_register(self->id, self->run->num_threads);
+    if (self->run->handles) self->run->Q->handle(self->run->queue, &self->hp_handle);
+    if (self->run->qsbr) HazardPointer_quiescent();
+    if (self->run->cfg->perf) self->perf_ok = PerfCounters_open(&self->perf);
+
+    pthread_barrier_wait(&self->run->barrier);
+    if (self->perf_ok) PerfCounters_start(&self->perf);
+    self->start_ns = Timing_now_ns();
+    switch (self->role) {
+        case ROLE_PRODUCER: run_producer(self); break;
+        case ROLE_CONSUMER: run_consumer(self); break;
+        case ROLE_MIXED: run_mixed(self); break;
+    }
+    self->end_ns = Timing_now_ns();
+    if (self->perf_ok) {
+        PerfCounters_stop(&self->perf);
+        PerfCounters_close(&self->perf);
+    }
+    if (self->run->qsbr) HazardPointer_offline();
+    return NULL;
+}
+
+//Splits num_threads according to the configured ratio, keeping at least one thread of each kind.
+//A single thread asked to both push and pop runs in mixed mode.
+static void assign_roles(const BenchConfig* cfg, BenchRun* run) {
+    int n = run->num_threads;
+    if (cfg->mixed || (n < 2 && cfg->ratio_push > 0 && cfg->ratio_pop > 0)) {
+        run->producers = 0;
+        run->consumers = 0;
+    }
+    else if (cfg->ratio_pop == 0) {
+        run->producers = n;
+        run->consumers = 0;
+    }
+    else if (cfg->ratio_push == 0) {
+        run->producers = 0;
+        run->consumers = n;
+    }
+    else {
+        int p = (int)((long)n * cfg->ratio_push / (cfg->ratio_push + cfg->ratio_pop));
+        if (p < 1) p = 1;
+        if (p > n - 1) p = n - 1;
+        run->producers = p;
+        run->consumers = n - p;
+    }
+
+    bool mixed = run->producers == 0 && run->consumers == 0;
+    for (int i = 0; i < n; i++) {
+        if (mixed) run->threads[i].role = ROLE_MIXED;
+        else run->threads[i].role = i < run->producers ? ROLE_PRODUCER : ROLE_CONSUMER;
+    }
+
+    int pushing = mixed ? n : run->producers;
+    run->items_per_thread = pushing > 0 ? cfg->items / pushing : 0;
+}
+
+//Fills cpus with the CPUs this process may run on; returns their number.
+static int allowed_cpus(int* cpus, int max) {
+    cpu_set_t set;
+    int count = 0;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) return 0;
+    for (int c = 0; c < CPU_SETSIZE && count < max; c++) {
+        if (CPU_ISSET(c, &set)) cpus[count++] = c;
+    }
+    return count;
+}
+
+static void print_csv_header(FILE* out) {
+    fprintf(out, "label,queue,threads,producers,consumers,prefill,pinned,run,thread,role,ops,empty_pops,seconds,ops_per_sec\n");
+}
+
+static void print_csv_row(FILE* out, const BenchConfig* cfg, const BenchRun* run, int rep,
+                          const char* thread, const char* role, long ops, long empty, double secs) {
+    fprintf(out, "%s,%s,%d,%d,%d,%ld,%d,%d,%s,%s,%ld,%ld,%.6f,%.0f\n",
+            cfg->label, run->name, run->num_threads, run->producers, run->consumers,
+            cfg->prefill, cfg->pin, rep, thread, role, ops, empty, secs, secs > 0 ? ops / secs : 0.0);
+}
+
+static void print_latency_csv_header(FILE* out) {
+    fprintf(out, "label,queue,threads,producers,consumers,prefill,pinned,run,op,count,p50_ns,p90_ns,p99_ns,p999_ns,max_ns\n");
+}
+
+//Merges the per-thread histograms of every operation and prints their percentiles in nanoseconds.
+static void report_latency(const BenchConfig* cfg, BenchRun* run, int rep, FILE* csv) {
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    double ticks_per_ns = Timing_cycles_per_ns();
+    Histogram* merged = malloc(sizeof(Histogram));
+    assert(merged);
+
+    for (int op = 0; op < NUM_OPS; op++) {
+        Histogram_init(merged);
+        for (int i = 0; i < run->num_threads; i++) Histogram_merge(merged, &run->threads[i].latency[op]);
+        if (merged->count == 0) continue;
+
+        double ns[5];
+        for (int k = 0; k < 4; k++) ns[k] = Histogram_percentile(merged, quantiles[k]) / ticks_per_ns;
+        ns[4] = merged->max / ticks_per_ns;
+
+        printf("    %-9s n=%-10lu p50=%.0fns p90=%.0fns p99=%.0fns p999=%.0fns max=%.0fns\n",
+               op_names[op], (unsigned long)merged->count, ns[0], ns[1], ns[2], ns[3], ns[4]);
+        if (csv) {
+            fprintf(csv, "%s,%s,%d,%d,%d,%ld,%d,%d,%s,%lu,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+                    cfg->label, run->name, run->num_threads, run->producers, run->consumers,
+                    cfg->prefill, cfg->pin, rep, op_names[op], (unsigned long)merged->count,
+                    ns[0], ns[1], ns[2], ns[3], ns[4]);
+        }
+    }
+
+    free(merged);
+    for (int i = 0; i < run->num_threads; i++) free(run->threads[i].latency);
+}
+
+//Prints sojourn-time percentiles over all items and per class of queue depth at push.
+//CSV rows go to the latency file with op "sojourn" or "sojourn_depth_<min depth>".
+static void report_sojourn(const BenchConfig* cfg, BenchRun* run, int rep, FILE* csv) {
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    double ticks_per_ns = Timing_cycles_per_ns();
+    Histogram* merged = malloc((SOJOURN_DEPTH_CLASSES + 1) * sizeof(Histogram));
+    assert(merged);
+    Histogram* all = &merged[SOJOURN_DEPTH_CLASSES];
+
+    Histogram_init(all);
+    for (int c = 0; c < SOJOURN_DEPTH_CLASSES; c++) {
+        Histogram_init(&merged[c]);
+        for (int i = 0; i < run->num_threads; i++) {
+            if (run->threads[i].sojourn) Histogram_merge(&merged[c], &run->threads[i].sojourn[c]);
+        }
+        Histogram_merge(all, &merged[c]);
+    }
+
+    for (int c = -1; c < SOJOURN_DEPTH_CLASSES; c++) {
+        Histogram* h = c < 0 ? all : &merged[c];
+        if (h->count == 0) continue;
+
+        char name[48], range[48];
+        unsigned long lo = c < 0 ? 0 : (unsigned long)Sojourn_class_min(c);
+        if (c < 0) snprintf(name, sizeof(name), "sojourn");
+        else snprintf(name, sizeof(name), "sojourn_depth_%lu", lo);
+        if (c < 0) snprintf(range, sizeof(range), "sojourn");
+        else if (c == SOJOURN_DEPTH_CLASSES - 1) snprintf(range, sizeof(range), "  depth >=%lu", lo);
+        else if (c < 2) snprintf(range, sizeof(range), "  depth %lu", lo);
+        else snprintf(range, sizeof(range), "  depth %lu-%lu", lo, (unsigned long)Sojourn_class_min(c + 1) - 1);
+
+        double ns[5];
+        for (int k = 0; k < 4; k++) ns[k] = Histogram_percentile(h, quantiles[k]) / ticks_per_ns;
+        ns[4] = h->max / ticks_per_ns;
+
+        printf("    %-21s n=%-10lu p50=%.0fns p90=%.0fns p99=%.0fns p999=%.0fns max=%.0fns\n",
+               range, (unsigned long)h->count, ns[0], ns[1], ns[2], ns[3], ns[4]);
+        if (csv) {
+            fprintf(csv, "%s,%s,%d,%d,%d,%ld,%d,%d,%s,%lu,%.1f,%.1f,%.1f,%.1f,%.1f\n",
+                    cfg->label, run->name, run->num_threads, run->producers, run->consumers,
+                    cfg->prefill, cfg->pin, rep, name, (unsigned long)h->count,
+                    ns[0], ns[1], ns[2], ns[3], ns[4]);
+        }
+    }
+
+    free(merged);
+    for (int i = 0; i < run->num_threads; i++) free(run->threads[i].sojourn);
+}
+
+//Sums the counters of all threads and prints them per completed queue operation.
+static void report_perf(BenchRun* run, long total_ops) {
+    uint64_t sums[PERF_NUM_EVENTS] = { 0 };
+    bool has[PERF_NUM_EVENTS] = { false };
+    int counted = 0;
+    for (int i = 0; i < run->num_threads; i++) {
+        BenchThread* t = &run->threads[i];
+        if (!t->perf_ok) continue;
+        counted++;
+        for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+            if (!PerfCounters_has(&t->perf, e)) continue;
+            has[e] = true;
+            sums[e] += t->perf.values[e];
+        }
+    }
+
+    if (counted == 0) {
+        static bool warned = false;
+        if (!warned) {
+            fprintf(stderr, "perf counters unavailable (check /proc/sys/kernel/perf_event_paranoid), continuing without them\n");
+            warned = true;
+        }
+        return;
+    }
+
+    printf("    perf/op (%d/%d threads):", counted, run->num_threads);
+    for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+        if (has[e]) printf(" %s=%.2f", PerfCounters_names[e], total_ops > 0 ? (double)sums[e] / total_ops : 0.0);
+    }
+    if (has[PERF_INSTRUCTIONS] && sums[PERF_CYCLES] > 0) printf(" ipc=%.2f", (double)sums[PERF_INSTRUCTIONS] / sums[PERF_CYCLES]);
+    printf("\n");
+}
+
+static void report_reclamation(const QueueVTable* Q, void* queue) {
+    HazardPointer_Stats* hs = malloc(sizeof(HazardPointer_Stats));
+    assert(hs);
+    Q->hazard_stats(queue, hs);
+    double ticks_per_ns = Timing_cycles_per_ns();
+    const HazardPointer_ThreadStats* t = &hs->total;
+    printf("    reclamation: retired=%lu peak/thread=%lu threshold=%lu scans=%lu (fruitless %lu) freed/scan=%.1f "
+           "avg scan=%.0fns max scan=%.0fns pinned=%zuKB peak<=%zuKB\n",
+           (unsigned long)t->retired, (unsigned long)t->peak_retired, (unsigned long)t->scan_threshold, (unsigned long)t->scans,
+           (unsigned long)t->fruitless_scans, hs->freed_per_scan,
+           t->scans > 0 ? t->scan_cycles / ticks_per_ns / t->scans : 0.0, t->max_scan_cycles / ticks_per_ns,
+           hs->bytes_pinned / 1024, hs->peak_bytes_pinned / 1024);
+    free(hs);
+}
+
+//Runs Q with the given ReclamationScheme and QueueBackoffPolicy, or its default ones if they are < 0.
+//Returns false if items were lost or duplicated.
+static bool bench_once(const BenchConfig* cfg, const QueueVTable* Q, int scheme, int backoff, int num_threads, int rep,
+                       FILE* csv, FILE* latency_csv) {
+    size_t size = sizeof(BenchRun) + num_threads * sizeof(BenchThread);
+    size = (size + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    BenchRun* run = aligned_alloc(CACHE_LINE, size);
+    assert(run);
+    memset(run, 0, size);
+    run->cfg = cfg;
+    run->Q = Q;
+    if (scheme >= 0) snprintf(run->name, sizeof(run->name), "%s/%s", Q->name, ReclamationScheme_names[scheme]);
+    else snprintf(run->name, sizeof(run->name), "%s", Q->name);
+    run->qsbr = Q->hazard_stats && (scheme >= 0 ? scheme : RECLAMATION_SCHEME) == RECLAIM_QSBR;
+    run->num_threads = num_threads;
+    atomic_init(&run->producers_done, 0);
+    assign_roles(cfg, run);
+
+    HazardPointer* hp = NULL;
+    if (cfg->reclaimer_us > 0 && Q->new_shared) {
+        hp = HazardPointer_new(scheme >= 0 ? scheme : RECLAMATION_SCHEME);
+        HazardPointer_start_reclaimer(hp, cfg->reclaimer_us, cfg->reclaimer_watermark);
+        strncat(run->name, "+bg", sizeof(run->name) - strlen(run->name) - 1);
+        run->queue = Q->new_shared(hp);
+    }
+    else run->queue = scheme >= 0 ? Q->new_with_scheme(scheme) : Q->new();
+    if (backoff >= 0) {
+        Q->set_backoff(run->queue, backoff);
+        size_t len = strlen(run->name);
+        snprintf(run->name + len, sizeof(run->name) - len, "+%s", QueueBackoff_policy_names[backoff]);
+    }
+    run->handles = cfg->handles && Q->handle && !cfg->sojourn;
+    if (run->handles) strncat(run->name, "+k", sizeof(run->name) - strlen(run->name) - 1);
+    HazardPointer_register(0, num_threads);
+    SojournQueue_init(&run->sojourn, Q, run->queue);
+    for (long i = 0; i < cfg->prefill; i++) queue_push(run, NULL, make_value(num_threads, i));
+    QueueDelay_configure(cfg->delay_mode, cfg->delay_probability, cfg->delay_ns);
+
+    int cpus[CPU_SETSIZE];
+    int num_cpus = cfg->pin ? allowed_cpus(cpus, CPU_SETSIZE) : 0;
+
+    pthread_barrier_init(&run->barrier, NULL, num_threads + 1);
+    for (int i = 0; i < num_threads; i++) {
+        BenchThread* t = &run->threads[i];
+        t->run = run;
+        t->id = i;
+        if (cfg->latency) {
+            t->latency = malloc(NUM_OPS * sizeof(Histogram));
+            assert(t->latency);
+            for (int op = 0; op < NUM_OPS; op++) Histogram_init(&t->latency[op]);
+        }
+        if (cfg->sojourn) {
+            t->sojourn = malloc(SOJOURN_DEPTH_CLASSES * sizeof(Histogram));
+            assert(t->sojourn);
+            for (int c = 0; c < SOJOURN_DEPTH_CLASSES; c++) Histogram_init(&t->sojourn[c]);
+        }
+
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        if (num_cpus > 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpus[i % num_cpus], &set);
+            pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+        }
+        int err = pthread_create(&t->handle, &attr, bench_thread, t);
+        if (err != 0) {
+            fprintf(stderr, "pthread_create: %s\n", strerror(err));
+            exit(EXIT_FAILURE);
+        }
+        pthread_attr_destroy(&attr);
+    }
+
+    pthread_barrier_wait(&run->barrier);
+    uint64_t start = UINT64_MAX, end = 0;
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(run->threads[i].handle, NULL);
+        if (run->threads[i].start_ns < start) start = run->threads[i].start_ns;
+        if (run->threads[i].end_ns > end) end = run->threads[i].end_ns;
+    }
+    pthread_barrier_destroy(&run->barrier);
+    QueueDelay_configure(QUEUE_DELAY_OFF, 0, 0);
+
+    long total_ops = 0, total_empty = 0, pushed = cfg->prefill, popped = 0;
+    double min_rate = -1, max_rate = 0, sum_rate = 0;
+    for (int i = 0; i < num_threads; i++) {
+        BenchThread* t = &run->threads[i];
+        double secs = (t->end_ns - t->start_ns) / 1e9;
+        double rate = secs > 0 ? t->ops / secs : 0;
+        total_ops += t->ops;
+        total_empty += t->empty_pops;
+        if (t->role == ROLE_PRODUCER) pushed += t->ops;
+        if (t->role == ROLE_CONSUMER) popped += t->ops;
+        if (min_rate < 0 || rate < min_rate) min_rate = rate;
+        if (rate > max_rate) max_rate = rate;
+        sum_rate += rate;
+
+        if (csv) {
+            char id[16];
+            snprintf(id, sizeof(id), "%d", i);
+            print_csv_row(csv, cfg, run, rep, id, role_names[t->role], t->ops, t->empty_pops, secs);
+        }
+    }
+
+    double secs = (end - start) / 1e9;
+    if (csv) print_csv_row(csv, cfg, run, rep, "all", "all", total_ops, total_empty, secs);
+
+    printf("%-12s threads=%3d (%dP/%dC) run=%d  %12.0f ops/s  per-thread min/avg/max %.0f/%.0f/%.0f  empty_pops=%ld\n",
+           run->name, num_threads, run->producers, run->consumers, rep,
+           secs > 0 ? total_ops / secs : 0.0, min_rate, sum_rate / num_threads, max_rate, total_empty);
+
+    //With dedicated consumers every pushed item must have been popped exactly once.
+    bool valid = run->consumers == 0 || popped == pushed;
+    if (!valid) fprintf(stderr, "%s: pushed %ld items but popped %ld\n", run->name, pushed, popped);
+
+    if (cfg->latency) report_latency(cfg, run, rep, latency_csv);
+    if (cfg->sojourn) report_sojourn(cfg, run, rep, latency_csv);
+    if (cfg->perf) report_perf(run, total_ops);
+    if (cfg->delay_mode != QUEUE_DELAY_OFF) {
+        printf("    injected delays:");
+        for (int p = 0; p < QUEUE_DELAY_NUM_POINTS; p++) {
+            if (QueueDelay_injected(p)) printf(" %s=%lu", QueueDelay_point_names[p], QueueDelay_injected(p));
+        }
+        printf("\n");
+    }
+
+    QueueStats stats;
+    Q->stats(run->queue, &stats);
+    if (stats.operations > 0) QueueStats_print(stdout, "    stats:", &stats);
+    if (Q->hazard_stats) report_reclamation(Q, run->queue);
+
+    Q->delete(run->queue);
+    if (hp) HazardPointer_delete(hp);
+    free(run);
+    return valid;
+}
+
+//Resident set size of this process in bytes.
+static size_t current_rss(void) {
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (!f) return 0;
+    unsigned long size = 0, resident = 0;
+    if (fscanf(f, "%lu %lu", &size, &resident) != 2) resident = 0;
+    fclose(f);
+    return resident * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+//Creates `instances` queues holding `depth` items each and compares the growth of the process RSS
+//with what <queue>_memory_usage accounts for.
+static void footprint_once(const BenchConfig* cfg, const QueueVTable* Q, long instances, long depth, FILE* csv) {
+    HazardPointer_register(0, 1);
+    malloc_trim(0);
+    size_t base = current_rss();
+
+    bool shared = cfg->shared_domain && Q->new_shared != NULL;
+    HazardPointer* hp = shared ? HazardPointer_new(RECLAMATION_SCHEME) : NULL;
+    char name[48];
+    snprintf(name, sizeof(name), "%s%s", Q->name, shared ? "/shared" : "");
+
+    void** queues = malloc(instances * sizeof(void*));
+    assert(queues);
+    uint64_t create_ns = 0;
+    for (long i = 0; i < instances; i++) {
+        uint64_t t0 = Timing_now_ns();
+        queues[i] = shared ? Q->new_shared(hp) : Q->new();
+        create_ns += Timing_now_ns() - t0;
+        for (long d = 0; d < depth; d++) Q->push(queues[i], make_value(0, d));
+    }
+    size_t rss = current_rss();
+    size_t grown = rss > base ? rss - base : 0;
+
+    QueueMemoryUsage total = { 0, 0, 0 };
+    for (long i = 0; i < instances; i++) {
+        QueueMemoryUsage usage;
+        Q->memory_usage(queues[i], &usage);
+        total.node_bytes += usage.node_bytes;
+        total.retired_bytes += usage.retired_bytes;
+        total.overhead_bytes += usage.overhead_bytes;
+    }
+    if (shared) {
+        size_t retired, overhead;
+        HazardPointer_memory_usage(hp, &retired, &overhead);
+        total.retired_bytes += retired;
+        total.overhead_bytes += overhead + sizeof(HazardPointer);
+    }
+    size_t accounted = total.node_bytes + total.retired_bytes + total.overhead_bytes;
+
+    printf("%-16s instances=%-7ld depth=%-8ld new=%.0fns rss=+%zuKB (%.0fB/queue, %.1fB/item)  accounted=%zuKB (nodes %zuKB, retired %zuKB, overhead %zuKB)\n",
+           name, instances, depth, (double)create_ns / instances, grown / 1024, (double)grown / instances,
+           depth > 0 ? (double)grown / (instances * depth) : 0.0, accounted / 1024,
+           total.node_bytes / 1024, total.retired_bytes / 1024, total.overhead_bytes / 1024);
+    if (csv) {
+        fprintf(csv, "%s,%s,%ld,%ld,%zu,%zu,%zu,%zu\n", cfg->label, name, instances, depth, grown,
+                total.node_bytes, total.retired_bytes, total.overhead_bytes);
+    }
+
+    for (long i = 0; i < instances; i++) Q->delete(queues[i]);
+    free(queues);
+    if (shared) HazardPointer_delete(hp);
+}
+
+static int parse_long_list(char* arg, long* out, int max) {
+    int n = 0;
+    for (char* tok = strtok(arg, ","); tok && n < max; tok = strtok(NULL, ",")) out[n++] = atol(tok);
+    return n;
+}
+
+static int parse_int_list(char* arg, int* out, int max) {
+    int n = 0;
+    for (char* tok = strtok(arg, ","); tok && n < max; tok = strtok(NULL, ",")) out[n++] = atoi(tok);
+    return n;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -q NAMES   comma-separated queues to run (default: all)\n"
+            "  -t COUNTS  comma-separated thread counts, each <= %d (default: 1,2,4)\n"
+            "  -r P:C     producer:consumer ratio, or 'mixed' for push/pop pairs on every thread (default: 1:1)\n"
+            "  -n ITEMS   items pushed per run (default: 1000000)\n"
+            "  -d DEPTH   items prefilled before measuring (default: 0)\n"
+            "  -a         pin threads to CPUs round-robin\n"
+            "  -e         consumers poll is_empty before every pop\n"
+            "  -L         record per-operation latency histograms and report percentiles\n"
+            "  -O FILE    write latency percentiles as CSV (implies -L)\n"
+            "  -S         sojourn mode: push timestamps and report time in queue by queue depth at push\n"
+            "  -k         LLQueue and BLQueue threads use the *_with operations through their own handle\n"
+            "  -P         count hardware events (perf_event_open) and report them per operation\n"
+            "  -x FACTORS comma-separated oversubscription factors: run FACTOR x (allowed CPUs) threads, overrides -t\n"
+            "  -y MODE    inject delays at the queues' critical windows: 'yield' or 'sleep:NS'\n"
+            "             (needs a build with -DQUEUE_DELAY_INJECTION=ON)\n"
+            "  -Y PROB    probability of a delay each time a delay point is hit (default: 0.001)\n"
+            "  -M         footprint mode: report RSS growth and accounted memory instead of throughput\n"
+            "  -I COUNTS  footprint mode: comma-separated numbers of queue instances (default: 1,100,1000)\n"
+            "  -D DEPTHS  footprint mode: comma-separated items per queue (default: 0,1000,100000)\n"
+            "  -s         footprint mode: LLQueue and BLQueue instances share one HazardPointer\n"
+            "  -B US[:MAX] LLQueue and BLQueue hand retired nodes to a background reclaimer scanning every US\n"
+            "             microseconds; retiring threads wait for it above MAX pending nodes (default: no limit)\n"
+            "  -m SCHEMES comma-separated reclamation schemes to run LLQueue and BLQueue with:\n"
+            "             hazard, epoch, qsbr, eras (default: the build's, see QUEUE_RECLAMATION)\n"
+            "  -b POLICIES comma-separated backoff policies to run LLQueue and BLQueue with after failed CASes:\n"
+            "             none, exp, adaptive (default: the build's, see QUEUE_BACKOFF)\n"
+            "  -T FILE    write the queues' trace events as Chrome trace JSON (needs a build with -DQUEUE_TRACE=ON)\n"
+            "  -R REPEATS repetitions of every configuration (default: 1)\n"
+            "  -o FILE    write per-thread and aggregate results as CSV\n"
+            "  -l LABEL   label stored in the CSV, e.g. a build id (default: default)\n",
+            prog, HAZARD_MAX_THREADS);
+}
+
+int main(int argc, char** argv) {
+    BenchConfig cfg = {
+        .num_queues = 0,
+        .num_schemes = 0,
+        .num_backoffs = 0,
+        .thread_counts = { 1, 2, 4 },
+        .num_thread_counts = 3,
+        .ratio_push = 1,
+        .ratio_pop = 1,
+        .mixed = false,
+        .items = 1000000,
+        .prefill = 0,
+        .pin = false,
+        .poll_empty = false,
+        .latency = false,
+        .perf = false,
+        .sojourn = false,
+        .handles = false,
+        .footprint = false,
+        .reclaimer_us = 0,
+        .reclaimer_watermark = 0,
+        .shared_domain = false,
+        .delay_mode = QUEUE_DELAY_OFF,
+        .delay_probability = 0.001,
+        .delay_ns = 0,
+        .depths = { 0, 1000, 100000 },
+        .num_depths = 3,
+        .instance_counts = { 1, 100, 1000 },
+        .num_instance_counts = 3,
+        .repeats = 1,
+        .output = NULL,
+        .latency_output = NULL,
+        .trace_output = NULL,
+        .label = "default",
+    };
+
+    int factors[MAX_LIST];
+    int num_factors = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "q:t:x:y:Y:r:n:d:aekLO:PSMsI:D:B:m:b:T:R:o:l:h")) != -1) {
+        switch (opt) {
+            case 'q':
+                for (char* tok = strtok(optarg, ","); tok; tok = strtok(NULL, ",")) {
+                    const QueueVTable* Q = QueueVTable_find(tok);
+                    if (!Q) {
+                        fprintf(stderr, "Unknown queue: %s\n", tok);
+                        return EXIT_FAILURE;
+                    }
+                    if (cfg.num_queues < MAX_LIST) cfg.queues[cfg.num_queues++] = Q;
+                }
+                break;
+            case 't': cfg.num_thread_counts = parse_int_list(optarg, cfg.thread_counts, MAX_LIST); break;
+            case 'x': num_factors = parse_int_list(optarg, factors, MAX_LIST); break;
+            case 'y':
+                if (strcmp(optarg, "yield") == 0) cfg.delay_mode = QUEUE_DELAY_YIELD;
+                else if (sscanf(optarg, "sleep:%ld", &cfg.delay_ns) == 1) cfg.delay_mode = QUEUE_DELAY_SLEEP;
+                else {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'Y': cfg.delay_probability = atof(optarg); break;
+            case 'r':
+                if (strcmp(optarg, "mixed") == 0) cfg.mixed = true;
+                else if (sscanf(optarg, "%d:%d", &cfg.ratio_push, &cfg.ratio_pop) != 2
+                         || cfg.ratio_push < 0 || cfg.ratio_pop < 0 || cfg.ratio_push + cfg.ratio_pop == 0) {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'n': cfg.items = atol(optarg); break;
+            case 'd': cfg.prefill = atol(optarg); break;
+            case 'a': cfg.pin = true; break;
+            case 'e': cfg.poll_empty = true; break;
+            case 'k': cfg.handles = true; break;
+            case 'L': cfg.latency = true; break;
+            case 'P': cfg.perf = true; break;
+            case 'S': cfg.sojourn = true; break;
+            case 'M': cfg.footprint = true; break;
+            case 's': cfg.shared_domain = true; break;
+            case 'B':
+                if (sscanf(optarg, "%ld:%zu", &cfg.reclaimer_us, &cfg.reclaimer_watermark) < 1) {
+                    usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'I': cfg.num_instance_counts = parse_long_list(optarg, cfg.instance_counts, MAX_LIST); break;
+            case 'D': cfg.num_depths = parse_long_list(optarg, cfg.depths, MAX_LIST); break;
+            case 'O':
+                cfg.latency = true;
+                cfg.latency_output = optarg;
+                break;
+            case 'm':
+                for (char* tok = strtok(optarg, ","); tok; tok = strtok(NULL, ",")) {
+                    int scheme = ReclamationScheme_find(tok);
+                    if (scheme < 0) {
+                        fprintf(stderr, "Unknown reclamation scheme: %s\n", tok);
+                        return EXIT_FAILURE;
+                    }
+                    if (cfg.num_schemes < RECLAIM_NUM_SCHEMES) cfg.schemes[cfg.num_schemes++] = scheme;
+                }
+                break;
+            case 'b':
+                for (char* tok = strtok(optarg, ","); tok; tok = strtok(NULL, ",")) {
+                    int policy = QueueBackoff_find(tok);
+                    if (policy < 0) {
+                        fprintf(stderr, "Unknown backoff policy: %s\n", tok);
+                        return EXIT_FAILURE;
+                    }
+                    if (cfg.num_backoffs < QUEUE_BACKOFF_NUM_POLICIES) cfg.backoffs[cfg.num_backoffs++] = policy;
+                }
+                break;
+            case 'T': cfg.trace_output = optarg; break;
+            case 'R': cfg.repeats = atoi(optarg); break;
+            case 'o': cfg.output = optarg; break;
+            case 'l': cfg.label = optarg; break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if (cfg.num_queues == 0) {
+        for (int i = 0; i < queueVTables_count; i++) cfg.queues[cfg.num_queues++] = &queueVTables[i];
+    }
+    if (num_factors > 0) {
+        int cpus[CPU_SETSIZE];
+        int num_cpus = allowed_cpus(cpus, CPU_SETSIZE);
+        if (num_cpus < 1) num_cpus = 1;
+        cfg.num_thread_counts = num_factors;
+        for (int i = 0; i < num_factors; i++) {
+            if (factors[i] < 1 || factors[i] > HAZARD_MAX_THREADS / num_cpus) {
+                fprintf(stderr, "%dx oversubscription of %d CPUs must stay in [1, %d] threads\n",
+                        factors[i], num_cpus, HAZARD_MAX_THREADS);
+                return EXIT_FAILURE;
+            }
+            cfg.thread_counts[i] = factors[i] * num_cpus;
+        }
+    }
+    if (cfg.delay_mode != QUEUE_DELAY_OFF && !QueueDelay_enabled()) {
+        fprintf(stderr, "Delay injection needs the queues built with -DQUEUE_DELAY_INJECTION=ON\n");
+        return EXIT_FAILURE;
+    }
+    if (cfg.trace_output && !QueueTrace_enabled()) {
+        fprintf(stderr, "Tracing needs the queues built with -DQUEUE_TRACE=ON\n");
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < cfg.num_thread_counts; i++) {
+        if (cfg.thread_counts[i] < 1 || cfg.thread_counts[i] > HAZARD_MAX_THREADS) {
+            fprintf(stderr, "Thread count must be in [1, %d]\n", HAZARD_MAX_THREADS);
+            return EXIT_FAILURE;
+        }
+    }
+
+    FILE* csv = NULL;
+    if (cfg.output) {
+        csv = fopen(cfg.output, "w");
+        if (!csv) {
+            fprintf(stderr, "%s: %s\n", cfg.output, strerror(errno));
+            return EXIT_FAILURE;
+        }
+        if (cfg.footprint) fprintf(csv, "label,queue,instances,depth,rss_bytes,node_bytes,retired_bytes,overhead_bytes\n");
+        else print_csv_header(csv);
+    }
+
+    if (cfg.footprint) {
+        for (int q = 0; q < cfg.num_queues; q++) {
+            for (int i = 0; i < cfg.num_instance_counts; i++) {
+                for (int d = 0; d < cfg.num_depths; d++) {
+                    footprint_once(&cfg, cfg.queues[q], cfg.instance_counts[i], cfg.depths[d], csv);
+                }
+            }
+        }
+        if (csv) fclose(csv);
+        return EXIT_SUCCESS;
+    }
+
+    FILE* latency_csv = NULL;
+    if (cfg.latency_output) {
+        latency_csv = fopen(cfg.latency_output, "w");
+        if (!latency_csv) {
+            fprintf(stderr, "%s: %s\n", cfg.latency_output, strerror(errno));
+            return EXIT_FAILURE;
+        }
+        print_latency_csv_header(latency_csv);
+    }
+    if (HazardPointer_asymmetric_fences()) printf("Hazard protection: plain stores, scans fence with membarrier\n");
+    if (cfg.latency) {
+        printf("Timer: %.2f ticks/ns, back-to-back overhead %lu ticks (included in every sample)\n",
+               Timing_cycles_per_ns(), (unsigned long)Timing_overhead());
+    }
+
+    bool valid = true;
+    for (int q = 0; q < cfg.num_queues; q++) {
+        const QueueVTable* Q = cfg.queues[q];
+        int num_schemes = Q->new_with_scheme && cfg.num_schemes > 0 ? cfg.num_schemes : 1;
+        for (int s = 0; s < num_schemes; s++) {
+            int scheme = Q->new_with_scheme && cfg.num_schemes > 0 ? cfg.schemes[s] : -1;
+            int num_backoffs = Q->set_backoff && cfg.num_backoffs > 0 ? cfg.num_backoffs : 1;
+            for (int b = 0; b < num_backoffs; b++) {
+                int backoff = Q->set_backoff && cfg.num_backoffs > 0 ? cfg.backoffs[b] : -1;
+                for (int t = 0; t < cfg.num_thread_counts; t++) {
+                    for (int rep = 0; rep < cfg.repeats; rep++) {
+                        if (!bench_once(&cfg, Q, scheme, backoff, cfg.thread_counts[t], rep, csv, latency_csv)) {
+                            valid = false;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    if (csv) fclose(csv);
+    if (latency_csv) fclose(latency_csv);
+    if (cfg.trace_output && !QueueTrace_dump(cfg.trace_output)) return EXIT_FAILURE;
+    return valid ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,130 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "HazardPointer.h"
+#include "Workload.h"
+
+//Generates workload traces for workloadReplay in a few common shapes:
+//  steady - producers push with Poisson arrivals at a fixed mean rate,
+//  bursty - producers push bursts back to back, then stay idle so the mean rate is unchanged,
+//  fanin  - steady with many producers and one consumer,
+//  fanout - steady with one producer and many consumers.
+//Consumers poll is_empty and then pop, evenly spaced over the producers' run and issuing
+//10% more pops than there are items so that the queue can drain.
+
+typedef enum { SHAPE_STEADY, SHAPE_BURSTY, SHAPE_FANIN, SHAPE_FANOUT } Shape;
+
+static const char* shape_names[] = { "steady", "bursty", "fanin", "fanout" };
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ull;
+
+static double next_uniform(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return ((rng_state * 0x2545f4914f6cdd1dull) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+//Exponentially distributed delay with the given mean, capped to fit a record.
+static uint32_t exponential_ns(double mean_ns) {
+    double d = -log(1.0 - next_uniform()) * mean_ns;
+    return d > UINT32_MAX ? UINT32_MAX : (uint32_t)d;
+}
+
+static Value make_value(int thread_id, long seq) {
+    return ((Value)(thread_id + 1) << 40) | (Value)(seq + 1);
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+            "Usage: %s -o FILE [options]\n"
+            "  -s SHAPE   steady, bursty, fanin or fanout (default: steady)\n"
+            "  -p N       producer threads (default: 2, fanin: 8, fanout: 1)\n"
+            "  -c N       consumer threads (default: 2, fanin: 1, fanout: 8); at most %d threads in total\n"
+            "  -n ITEMS   items pushed per producer (default: 100000)\n"
+            "  -r RATE    mean items per second per producer (default: 1000000)\n"
+            "  -b BURST   items per burst for the bursty shape (default: 256)\n"
+            "  -S SEED    random seed (default: fixed)\n"
+            "  -o FILE    output trace, CSV if it ends in .csv, binary otherwise\n",
+            prog, WORKLOAD_MAX_THREADS);
+}
+
+int main(int argc, char** argv) {
+    Shape shape = SHAPE_STEADY;
+    int producers = -1, consumers = -1;
+    long items = 100000, burst = 256;
+    double rate = 1e6;
+    const char* output = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:p:c:n:r:b:S:o:h")) != -1) {
+        switch (opt) {
+            case 's': {
+                int found = -1;
+                for (int i = 0; i < 4; i++) {
+                    if (strcmp(optarg, shape_names[i]) == 0) found = i;
+                }
+                if (found < 0) {
+                    fprintf(stderr, "Unknown shape: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                shape = found;
+                break;
+            }
+            case 'p': producers = atoi(optarg); break;
+            case 'c': consumers = atoi(optarg); break;
+            case 'n': items = atol(optarg); break;
+            case 'r': rate = atof(optarg); break;
+            case 'b': burst = atol(optarg); break;
+            case 'S': rng_state = strtoull(optarg, NULL, 0) | 1; break;
+            case 'o': output = optarg; break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if (producers < 0) producers = shape == SHAPE_FANIN ? 8 : shape == SHAPE_FANOUT ? 1 : 2;
+    if (consumers < 0) consumers = shape == SHAPE_FANIN ? 1 : shape == SHAPE_FANOUT ? 8 : 2;
+    if (!output || producers < 1 || consumers < 1 || producers > WORKLOAD_MAX_THREADS - consumers
+        || items < 1 || rate <= 0 || burst < 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    Workload w;
+    Workload_init(&w);
+    double mean_ns = 1e9 / rate;
+
+    for (int p = 0; p < producers; p++) {
+        for (long i = 0; i < items; i++) {
+            uint32_t delay;
+            if (shape == SHAPE_BURSTY) delay = i % burst == 0 ? exponential_ns(mean_ns * burst) : 0;
+            else delay = exponential_ns(mean_ns);
+            Workload_append(&w, p, WORKLOAD_PUSH, make_value(p, i), delay);
+        }
+    }
+
+    long pops = (long)ceil(1.1 * items * producers / consumers);
+    double duration_ns = items * mean_ns;
+    double poll_ns = duration_ns / pops;
+    for (int c = 0; c < consumers; c++) {
+        for (long i = 0; i < pops; i++) {
+            Workload_append(&w, producers + c, WORKLOAD_IS_EMPTY, 0, (uint32_t)poll_ns);
+            Workload_append(&w, producers + c, WORKLOAD_POP, 0, 0);
+        }
+    }
+
+    bool ok = Workload_save(&w, output);
+    if (ok) {
+        printf("%s: %zu records, %d producers, %d consumers, %s, ~%.3fs at recorded speed\n",
+               output, w.count, producers, consumers, shape_names[shape], duration_ns / 1e9);
+    }
+    Workload_free(&w);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
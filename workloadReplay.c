@@ -0,0 +1,293 @@
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "HazardPointer.h"
+#include "Histogram.h"
+#include "QueueVTable.h"
+#include "Timing.h"
+#include "Workload.h"
+
+//Replays a workload trace (see Workload.h, workloadGen) against queues from queueVTables.
+//Each trace thread gets its own OS thread that issues its operations at the recorded times
+//(scaled by -s), and reports throughput, per-operation latency, how far behind schedule
+//operations were issued, and memory.
+
+#define CACHE_LINE 64
+#define MAX_LIST 32
+
+struct ReplayRun;
+
+typedef struct ReplayThread {
+    _Alignas(CACHE_LINE) pthread_t handle;
+    struct ReplayRun* run;
+    int id;
+    const WorkloadRecord** ops; //This thread's records, in trace order.
+    long num_ops;
+    long empty_pops;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    Histogram latency[WORKLOAD_NUM_OPS]; //Service time in Timing_cycles ticks.
+    Histogram lag;                       //Issue time minus scheduled time, in ns.
+} ReplayThread;
+
+typedef struct ReplayRun {
+    const QueueVTable* Q;
+    void* queue;
+    double speed; //0 replays as fast as possible.
+    int num_threads;
+    pthread_barrier_t barrier;
+    _Alignas(CACHE_LINE) uint64_t start_ns;
+    ReplayThread* threads;
+} ReplayRun;
+
+//Sleeps through most of the wait and spins for the last stretch to hit due_ns precisely.
+static void wait_until(uint64_t due_ns) {
+    for (;;) {
+        uint64_t now = Timing_now_ns();
+        if (now >= due_ns) return;
+        if (due_ns - now > 100000) {
+            struct timespec ts = { 0, (long)(due_ns - now - 50000) };
+            nanosleep(&ts, NULL);
+        }
+    }
+}
+
+static void* replay_thread(void* arg) {
+    ReplayThread* self = arg;
+    ReplayRun* run = self->run;
+    const QueueVTable* Q = run->Q;
+    HazardPointer_register(self->id, run->num_threads);
+
+    pthread_barrier_wait(&run->barrier);
+    self->start_ns = Timing_now_ns();
+    double due = (double)run->start_ns;
+    for (long i = 0; i < self->num_ops; i++) {
+        const WorkloadRecord* r = self->ops[i];
+        if (run->speed > 0) {
+            due += r->delay_ns / run->speed;
+            wait_until((uint64_t)due);
+            uint64_t now = Timing_now_ns();
+            Histogram_record(&self->lag, now > due ? now - (uint64_t)due : 0);
+        }
+
+        uint64_t t0 = Timing_cycles();
+        switch (r->op) {
+            case WORKLOAD_PUSH: Q->push(run->queue, r->value); break;
+            case WORKLOAD_POP:
+                if (Q->pop(run->queue) == EMPTY_VALUE) self->empty_pops++;
+                break;
+            case WORKLOAD_IS_EMPTY: Q->is_empty(run->queue); break;
+        }
+        Histogram_record(&self->latency[r->op], Timing_cycles() - t0);
+    }
+    self->end_ns = Timing_now_ns();
+    return NULL;
+}
+
+static size_t current_rss(void) {
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (!f) return 0;
+    unsigned long size = 0, resident = 0;
+    if (fscanf(f, "%lu %lu", &size, &resident) != 2) resident = 0;
+    fclose(f);
+    return resident * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+//Returns false if items were lost or duplicated.
+static bool replay(const Workload* w, const QueueVTable* Q, double speed, const char* label, FILE* csv) {
+    ReplayRun run = { .Q = Q, .speed = speed, .num_threads = w->num_threads };
+    run.threads = aligned_alloc(CACHE_LINE, w->num_threads * sizeof(ReplayThread));
+    assert(run.threads);
+    memset(run.threads, 0, w->num_threads * sizeof(ReplayThread));
+
+    //Split the trace by thread, keeping each thread's records in order.
+    for (size_t i = 0; i < w->count; i++) run.threads[w->records[i].thread].num_ops++;
+    for (int t = 0; t < w->num_threads; t++) {
+        ReplayThread* thread = &run.threads[t];
+        thread->run = &run;
+        thread->id = t;
+        thread->ops = malloc((thread->num_ops + 1) * sizeof(WorkloadRecord*));
+        assert(thread->ops);
+        thread->num_ops = 0;
+        for (int op = 0; op < WORKLOAD_NUM_OPS; op++) Histogram_init(&thread->latency[op]);
+        Histogram_init(&thread->lag);
+    }
+    long pushes = 0;
+    for (size_t i = 0; i < w->count; i++) {
+        ReplayThread* thread = &run.threads[w->records[i].thread];
+        thread->ops[thread->num_ops++] = &w->records[i];
+        if (w->records[i].op == WORKLOAD_PUSH) pushes++;
+    }
+
+    malloc_trim(0);
+    size_t base_rss = current_rss();
+    run.queue = Q->new();
+
+    pthread_barrier_init(&run.barrier, NULL, w->num_threads + 1);
+    for (int t = 0; t < w->num_threads; t++) {
+        int err = pthread_create(&run.threads[t].handle, NULL, replay_thread, &run.threads[t]);
+        if (err != 0) {
+            fprintf(stderr, "pthread_create: %s\n", strerror(err));
+            exit(EXIT_FAILURE);
+        }
+    }
+    //Give every thread the same time origin, slightly in the future so that all are waiting for it.
+    run.start_ns = Timing_now_ns() + 1000000;
+    pthread_barrier_wait(&run.barrier);
+
+    uint64_t end = 0;
+    for (int t = 0; t < w->num_threads; t++) {
+        pthread_join(run.threads[t].handle, NULL);
+        if (run.threads[t].end_ns > end) end = run.threads[t].end_ns;
+    }
+    pthread_barrier_destroy(&run.barrier);
+    size_t end_rss = current_rss();
+
+    QueueMemoryUsage usage;
+    Q->memory_usage(run.queue, &usage);
+
+    //Whatever consumers did not take is still queued.
+    HazardPointer_register(0, w->num_threads);
+    long left = 0, popped = 0, empty = 0;
+    while (Q->pop(run.queue) != EMPTY_VALUE) left++;
+
+    Histogram* merged = malloc((WORKLOAD_NUM_OPS + 1) * sizeof(Histogram));
+    assert(merged);
+    for (int op = 0; op <= WORKLOAD_NUM_OPS; op++) Histogram_init(&merged[op]);
+    for (int t = 0; t < w->num_threads; t++) {
+        ReplayThread* thread = &run.threads[t];
+        for (int op = 0; op < WORKLOAD_NUM_OPS; op++) Histogram_merge(&merged[op], &thread->latency[op]);
+        Histogram_merge(&merged[WORKLOAD_NUM_OPS], &thread->lag);
+        empty += thread->empty_pops;
+    }
+    popped = (long)merged[WORKLOAD_POP].count - empty;
+
+    uint64_t first = run.start_ns;
+    if (speed == 0) {
+        for (int t = 0; t < w->num_threads; t++) {
+            if (run.threads[t].start_ns < first) first = run.threads[t].start_ns;
+        }
+    }
+    double secs = end > first ? (end - first) / 1e9 : 0.0;
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    printf("%-12s ops=%zu  %.3fs  %12.0f ops/s  popped=%ld empty_pops=%ld left=%ld  rss=+%zuKB (max %ldKB)  queue=%zuKB\n",
+           Q->name, w->count, secs, secs > 0 ? w->count / secs : 0.0, popped, empty, left,
+           end_rss > base_rss ? (end_rss - base_rss) / 1024 : 0, ru.ru_maxrss,
+           (usage.node_bytes + usage.retired_bytes + usage.overhead_bytes) / 1024);
+    bool valid = popped + left == pushes;
+    if (!valid) fprintf(stderr, "%s: pushed %ld items but popped %ld and %ld left\n", Q->name, pushes, popped, left);
+
+    double ticks_per_ns = Timing_cycles_per_ns();
+    for (int op = 0; op <= WORKLOAD_NUM_OPS; op++) {
+        Histogram* h = &merged[op];
+        if (h->count == 0) continue;
+        double scale = op < WORKLOAD_NUM_OPS ? ticks_per_ns : 1.0;
+        const char* name = op < WORKLOAD_NUM_OPS ? Workload_op_names[op] : "lag";
+        double p50 = Histogram_percentile(h, 0.5) / scale, p99 = Histogram_percentile(h, 0.99) / scale;
+        double p999 = Histogram_percentile(h, 0.999) / scale, max = h->max / scale;
+        printf("    %-9s n=%-10lu p50=%.0fns p99=%.0fns p999=%.0fns max=%.0fns\n",
+               name, (unsigned long)h->count, p50, p99, p999, max);
+        if (csv) {
+            fprintf(csv, "%s,%s,%.3f,%zu,%.6f,%ld,%ld,%zu,%s,%lu,%.1f,%.1f,%.1f,%.1f\n", label, Q->name, speed,
+                    w->count, secs, left, empty, end_rss > base_rss ? end_rss - base_rss : 0, name,
+                    (unsigned long)h->count, p50, p99, p999, max);
+        }
+    }
+
+    free(merged);
+    Q->delete(run.queue);
+    for (int t = 0; t < w->num_threads; t++) free(run.threads[t].ops);
+    free(run.threads);
+    return valid;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr,
+            "Usage: %s -f TRACE [options]\n"
+            "  -f TRACE   workload trace (CSV or binary, see workloadGen)\n"
+            "  -q NAMES   comma-separated queues to run (default: all)\n"
+            "  -s SPEED   replay speed relative to the recorded times, 0 for as fast as possible (default: 1)\n"
+            "  -o FILE    write results as CSV\n"
+            "  -l LABEL   label stored in the CSV (default: default)\n",
+            prog);
+}
+
+int main(int argc, char** argv) {
+    const QueueVTable* queues[MAX_LIST];
+    int num_queues = 0;
+    const char* trace = NULL;
+    const char* output = NULL;
+    const char* label = "default";
+    double speed = 1.0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "f:q:s:o:l:h")) != -1) {
+        switch (opt) {
+            case 'f': trace = optarg; break;
+            case 'q':
+                for (char* tok = strtok(optarg, ","); tok; tok = strtok(NULL, ",")) {
+                    const QueueVTable* Q = QueueVTable_find(tok);
+                    if (!Q) {
+                        fprintf(stderr, "Unknown queue: %s\n", tok);
+                        return EXIT_FAILURE;
+                    }
+                    if (num_queues < MAX_LIST) queues[num_queues++] = Q;
+                }
+                break;
+            case 's': speed = atof(optarg); break;
+            case 'o': output = optarg; break;
+            case 'l': label = optarg; break;
+            default:
+                usage(argv[0]);
+                return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (!trace || speed < 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (num_queues == 0) {
+        for (int i = 0; i < queueVTables_count; i++) queues[num_queues++] = &queueVTables[i];
+    }
+
+    Workload w;
+    if (!Workload_load(&w, trace)) return EXIT_FAILURE;
+    if (w.count == 0) {
+        fprintf(stderr, "%s: empty trace\n", trace);
+        return EXIT_FAILURE;
+    }
+
+    FILE* csv = NULL;
+    if (output) {
+        csv = fopen(output, "w");
+        if (!csv) {
+            fprintf(stderr, "%s: %s\n", output, strerror(errno));
+            return EXIT_FAILURE;
+        }
+        fprintf(csv, "label,queue,speed,ops,seconds,left,empty_pops,rss_bytes,op,count,p50_ns,p99_ns,p999_ns,max_ns\n");
+    }
+
+    printf("%s: %zu records on %d threads\n", trace, w.count, w.num_threads);
+    bool valid = true;
+    for (int q = 0; q < num_queues; q++) {
+        if (!replay(&w, queues[q], speed, label, csv)) valid = false;
+    }
+
+    if (csv) fclose(csv);
+    Workload_free(&w);
+    return valid ? EXIT_SUCCESS : EXIT_FAILURE;
+}